@@ -1,20 +1,250 @@
 #pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
 #include <bitset>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <initializer_list>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <map>
+#include <new>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
 #include <vector>
 #include <type_traits>
+#include <utility>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <xmmintrin.h>
+#endif
+
+// Frame arenas overwrite released scratch memory with a fill pattern, so use past the end of the
+// frame reads garbage instead of stale data that looks valid. On by default in debug builds
+#ifndef ECS_ARENA_POISON
+#ifdef NDEBUG
+#define ECS_ARENA_POISON 0
+#else
+#define ECS_ARENA_POISON 1
+#endif
+#endif
 
 namespace ECS
 {
 	constexpr size_t MAX_COMPONENTS = 64;
 	constexpr size_t MAX_ENTITIES   = 1000000;
+	constexpr size_t QUERY_PROBE_COST = 2;  // Relative cost of probing an entity's mask versus scanning it linearly
+	constexpr size_t DORMANT_CHUNK_SIZE = 1024;  // Entities per chunk when skipping chunks that have no awake entity
+	constexpr size_t SUMMARY_CHUNK_SIZE = DORMANT_CHUNK_SIZE;  // Entities per min/max summary, matching dormant chunks so scans skip both at the same boundaries
+	constexpr size_t REDUCE_BLOCK_SIZE = 16 * DORMANT_CHUNK_SIZE;  // Candidates per block of a query reduction
+	constexpr size_t REDUCE_PARALLEL_BLOCKS = 4;  // Fewest blocks a reduction spreads over worker threads
+	constexpr size_t JOIN_BATCH_SIZE = 256;  // Matches a join gathers and sorts by target before visiting them
+	constexpr size_t JOIN_PREFETCH_DISTANCE = 8;  // How many targets ahead a join prefetches
 
 	using ComponentID   = unsigned long long;
 	using EntityIndex   = unsigned int;
 	using EntityVersion = unsigned int;
 	using EntityID      = unsigned long long;  // Top 32 bits have index and bottom 32 bits have version
 	using ComponentMask = std::bitset<MAX_COMPONENTS>;
+
+	// The top bits of every mask hold entity state, so queries can test them in the same compare as the components
+	constexpr ComponentID ENABLED_BIT         = MAX_COMPONENTS - 1;
+	constexpr ComponentID AWAKE_BIT           = MAX_COMPONENTS - 2;
+	constexpr size_t      MAX_USER_COMPONENTS = MAX_COMPONENTS - 2;
+
+	// Returns only the component bits of a mask, without the entity state bits
+	inline unsigned long long ComponentBits(const ComponentMask& mask)
+	{
+		return mask.to_ullong() & ((1ull << MAX_USER_COMPONENTS) - 1);
+	}
+
+	// Called with a site name and a size whenever the ECS allocates storage of its own
+	using AllocationHook = void (*)(const char* site, size_t bytes);
+
+	inline std::atomic<AllocationHook> s_allocationHook{ nullptr };
+
+	// Installs the allocation hook, nullptr removes it. Returns the previous hook
+	inline AllocationHook SetAllocationHook(AllocationHook hook)
+	{
+		return s_allocationHook.exchange(hook);
+	}
+
+	inline void NoteAllocation(const char* site, size_t bytes)
+	{
+		if (AllocationHook hook = s_allocationHook.load(std::memory_order_relaxed))
+			hook(site, bytes);
+	}
+
+	// Standard allocator that reports each allocation to the allocation hook under its site name
+	template <typename T>
+	class TrackedAllocator
+	{
+	public:
+		using value_type      = T;
+		using is_always_equal = std::true_type;
+
+		TrackedAllocator(const char* site = "ECS")
+			:
+			m_site(site)
+		{
+		}
+
+		template <typename U>
+		TrackedAllocator(const TrackedAllocator<U>& other)
+			:
+			m_site(other.m_site)
+		{
+		}
+
+		T* allocate(size_t count)
+		{
+			NoteAllocation(m_site, count * sizeof(T));
+			return std::allocator<T>().allocate(count);
+		}
+
+		void deallocate(T* data, size_t count)
+		{
+			std::allocator<T>().deallocate(data, count);
+		}
+
+		template <typename U>
+		bool operator==(const TrackedAllocator<U>&) const
+		{
+			return true;
+		}
+
+	private:
+		template <typename U>
+		friend class TrackedAllocator;
+
+		const char* m_site;
+	};
+
+	template <typename T>
+	using TrackedVector = std::vector<T, TrackedAllocator<T>>;
+
+	// Counts the ECS allocations made on any thread while it is alive. Wrap a warmed up frame in
+	// one to prove it allocates nothing: on destruction it prints the sites that allocated to
+	// stderr and asserts. Scopes take over the allocation hook, so only one may be alive at a time
+	class ZeroAllocationScope
+	{
+	public:
+		static constexpr size_t MAX_SITES = 64;
+
+		ZeroAllocationScope()
+		{
+			assert(s_active == nullptr && "Zero allocation scopes do not nest");
+			s_active = this;
+			m_previousHook = SetAllocationHook(&Record);
+		}
+
+		~ZeroAllocationScope()
+		{
+			SetAllocationHook(m_previousHook);
+			s_active = nullptr;
+
+			if (AllocationCount() != 0)
+			{
+				Report(stderr);
+				assert(false && "The ECS allocated inside a zero allocation scope");
+			}
+		}
+
+		ZeroAllocationScope(const ZeroAllocationScope&) = delete;
+		ZeroAllocationScope& operator=(const ZeroAllocationScope&) = delete;
+
+		size_t AllocationCount() const
+		{
+			size_t count = m_unlistedCount;
+			for (const Site& site : m_sites)
+				count += site.m_count;
+			return count;
+		}
+
+		// Writes one line per site that allocated, with its allocation count and bytes
+		void Report(FILE* file) const
+		{
+			for (const Site& site : m_sites)
+			{
+				if (const char* name = site.m_name.load())
+					std::fprintf(file, "ECS allocation at %s: %zu allocations, %zu bytes\n", name, size_t(site.m_count), size_t(site.m_bytes));
+			}
+
+			if (m_unlistedCount != 0)
+				std::fprintf(file, "ECS allocation at more sites than tracked: %zu allocations\n", size_t(m_unlistedCount));
+		}
+
+	private:
+		struct Site
+		{
+			std::atomic<const char*> m_name{ nullptr };
+			std::atomic<size_t>      m_count{ 0 };
+			std::atomic<size_t>      m_bytes{ 0 };
+		};
+
+		// Recording must not allocate itself, so sites live in a fixed table claimed lock-free
+		static void Record(const char* name, size_t bytes)
+		{
+			// A thread may still call in with the hook it loaded just before the scope ended
+			ZeroAllocationScope* scope = s_active;
+			if (scope == nullptr)
+				return;
+
+			for (Site& site : scope->m_sites)
+			{
+				const char* expected = nullptr;
+				if (site.m_name.compare_exchange_strong(expected, name) || std::strcmp(expected, name) == 0)
+				{
+					site.m_count++;
+					site.m_bytes += bytes;
+					return;
+				}
+			}
+
+			scope->m_unlistedCount++;
+		}
+
+		static inline std::atomic<ZeroAllocationScope*> s_active{ nullptr };
+
+		Site                m_sites[MAX_SITES];
+		std::atomic<size_t> m_unlistedCount{ 0 };
+		AllocationHook      m_previousHook{ nullptr };
+	};
 	
-	extern ComponentID s_componentCounter = 0;
+	class ComponentPool;
+
+	// Describes a registered component type
+	struct ComponentInfo
+	{
+		std::string_view   m_name;
+		unsigned long long m_hash{ 0 };  // Hash of the type name, stable between runs of the same build
+		size_t             m_size{ 0 };
+		size_t             m_alignment{ 0 };
+		bool               m_triviallyCopyable{ false };
+
+		// Type-erased lifetime functions, null when a memcpy or nothing at all will do
+		void (*m_relocate)(void* dst, void* src){ nullptr };  // Move-constructs dst from src, then destroys src
+		void (*m_copy)(void* dst, const void* src){ nullptr };  // Copy-constructs dst from src
+		void (*m_destroy)(void* ptr){ nullptr };
+		void (*m_bind)(void* ptr, ComponentPool* pool){ nullptr };  // Attaches a component just placed in the pool to the pool's storage
+	};
+
+	inline std::atomic<ComponentID> s_componentCounter{ 0 };  // Number of published entries in s_componentInfo
+	inline std::mutex               s_registryMutex;            // Serializes registration
+	inline ComponentInfo            s_componentInfo[MAX_COMPONENTS];
 
 
 	namespace  // Anon namespace for helper functions
@@ -42,260 +272,3845 @@ namespace ECS
 			// Check if the index is our invalid index
 			return (id >> 32) != EntityIndex(-1);
 		}
+
+		// Starts pulling the cache line at 'address' in, a no-op where the compiler has no hint
+		inline void Prefetch(const void* address)
+		{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+			_mm_prefetch(static_cast<const char*>(address), _MM_HINT_T0);
+#elif defined(__GNUC__) || defined(__clang__)
+			__builtin_prefetch(address);
+#else
+			(void)address;
+#endif
+		}
 	}
 
 #define INVALID_ENTITY ECS::CreateEntityId(EntityIndex(-1), 0)
 
-	template <class T>
-	ComponentID GetId()
+	// Extracts the type's name from the compiler's function signature
+	template <typename T>
+	constexpr std::string_view TypeName()
 	{
-		static ComponentID s_componentId = s_componentCounter++;
-		return s_componentId;
+#if defined(_MSC_VER)
+		std::string_view name = __FUNCSIG__;
+		name.remove_prefix(name.find("TypeName<") + 9);
+		name.remove_suffix(name.size() - name.rfind(">(void)"));
+
+		for (std::string_view keyword : { "struct ", "class ", "enum " })
+		{
+			if (name.starts_with(keyword))
+				name.remove_prefix(keyword.size());
+		}
+#else
+		std::string_view name = __PRETTY_FUNCTION__;
+		name.remove_prefix(name.find("T = ") + 4);
+		name.remove_suffix(name.size() - name.find_first_of(";]", 0));
+#endif
+		return name;
 	}
 
-	class ComponentPool
+	// FNV-1a, used to give component types an identity that survives between runs
+	constexpr unsigned long long HashName(std::string_view name)
 	{
-	public:
-		explicit ComponentPool(size_t elementSize)
-			:
-			m_elementSize(elementSize)
+		unsigned long long hash = 14695981039346656037ull;
+		for (char c : name)
 		{
-			m_data = new std::byte[MAX_ENTITIES * m_elementSize];
+			hash ^= (unsigned char)c;
+			hash *= 1099511628211ull;
 		}
+		return hash;
+	}
 
-		~ComponentPool()
+	template <typename T>
+	void RelocateComponent(void* dst, void* src)
+	{
+		new (dst) T(std::move(*static_cast<T*>(src)));
+		static_cast<T*>(src)->~T();
+	}
+
+	template <typename T>
+	void CopyComponent(void* dst, const void* src)
+	{
+		new (dst) T(*static_cast<const T*>(src));
+	}
+
+	template <typename T>
+	void DestroyComponent(void* ptr)
+	{
+		static_cast<T*>(ptr)->~T();
+	}
+
+	// Buffer components, and the lifetime functions that keep their overflow in the pool's arena
+	template <typename T>
+	struct IsBuffer;
+
+	template <typename T>
+	struct BufferOps;
+
+	// Writes the entry and only then publishes it by raising the count, so readers that load
+	// the count with acquire see complete entries. Callers hold s_registryMutex
+	inline ComponentID PublishComponent(const ComponentInfo& info)
+	{
+		ComponentID componentId = s_componentCounter.load(std::memory_order_relaxed);
+		assert(componentId < MAX_USER_COMPONENTS && "Too many component types, increase MAX_COMPONENTS");
+
+		s_componentInfo[componentId] = info;
+		s_componentCounter.store(componentId + 1, std::memory_order_release);
+		return componentId;
+	}
+
+	template <typename T>
+	ComponentID RegisterComponentType()
+	{
+		ComponentInfo info
 		{
-			delete[] m_data;
-		}
-		
-		ComponentPool() = delete;
-		bool operator==(const ComponentPool& other) const = delete;
+			TypeName<T>(),
+			HashName(TypeName<T>()),
+			sizeof(T),
+			alignof(T),
+			std::is_trivially_copyable_v<T>
+		};
 
-		template <typename T>
-		T* Get(size_t index)
+		if constexpr (!std::is_trivially_copyable_v<T> && std::is_move_constructible_v<T>)
+			info.m_relocate = &RelocateComponent<T>;
+
+		if constexpr (!std::is_trivially_copyable_v<T> && std::is_copy_constructible_v<T>)
+			info.m_copy = &CopyComponent<T>;
+
+		if constexpr (!std::is_trivially_destructible_v<T>)
+			info.m_destroy = &DestroyComponent<T>;
+
+		// Moving a buffer out of a pool detaches it from the arena, moves within the pool must not
+		if constexpr (IsBuffer<T>::value)
 		{
-			return reinterpret_cast<T*>(&m_data[index * m_elementSize]);
+			info.m_relocate = &BufferOps<T>::Relocate;
+			info.m_bind = &BufferOps<T>::Bind;
 		}
 
-	private:
-		size_t m_elementSize{ 0 };
-		std::byte* m_data{ nullptr };
-	};
+		std::lock_guard lock(s_registryMutex);
+		return PublishComponent(info);
+	}
 
-	class World
+	// Component IDs are handed out on first use, the function-local static makes
+	// this thread-safe and every later call a single load
+	template <class T>
+	ComponentID GetId()
 	{
-	private:
-		// Contains the entity's id and component mask
-		struct EntityDesc
-		{
-			EntityID m_id;
-			ComponentMask m_mask;
-		};
+		static const ComponentID s_componentId = RegisterComponentType<T>();
+		return s_componentId;
+	}
 
-	public:
-		World() = default;
+	// Registers component types up front in the given order. Calling this at startup
+	// makes IDs identical between runs and keeps first-use registration out of hot loops
+	template <typename... T>
+	void RegisterComponents()
+	{
+		(GetId<T>(), ...);
+	}
 
-		[[maybe_unused]] 
-		EntityID NewEntity()
+	// Registers a component type defined at runtime, such as one declared by a script.
+	// Runtime components are plain bytes, so they are always trivially copyable
+	inline ComponentID RegisterComponent(std::string_view name, size_t size, size_t alignment = alignof(std::max_align_t))
+	{
+		static std::deque<std::string> s_names;  // Owns runtime names, a deque never moves its elements
+
+		std::lock_guard lock(s_registryMutex);
+		std::string_view ownedName = s_names.emplace_back(name);
+
+		return PublishComponent(ComponentInfo
 		{
-			// Check for free slots
-			if (!m_freeEntities.empty())
-			{
-				EntityIndex newIndex = m_freeEntities.back();
-				m_freeEntities.pop_back();
-				
-				EntityID newID = CreateEntityId(newIndex, GetEntityVersion(m_entities[newIndex].m_id));
-				m_entities[newIndex].m_id = newID;
-				
-				return m_entities[newIndex].m_id;
-			}
+			ownedName,
+			HashName(ownedName),
+			size,
+			alignment,
+			true
+		});
+	}
 
-			m_entities.push_back(
-				{  // Entity desc
-					CreateEntityId(EntityIndex(m_entities.size()), 0),
-					ComponentMask()
-				});
+	inline size_t ComponentCount()
+	{
+		return (size_t)s_componentCounter.load(std::memory_order_acquire);
+	}
 
-			return m_entities.back().m_id;
-		}
+	inline const ComponentInfo& GetComponentInfo(ComponentID componentId)
+	{
+		return s_componentInfo[componentId];
+	}
 
-		void DestroyEntity(EntityID id)
+	// Looks up a component by its name hash, returns ComponentID(-1) if no such type is registered
+	inline ComponentID FindComponent(unsigned long long hash)
+	{
+		ComponentID count = ComponentCount();
+		for (ComponentID componentId = 0; componentId < count; componentId++)
 		{
-			EntityID newID = CreateEntityId(EntityIndex(-1), GetEntityVersion(id) + 1);
-			m_entities[GetEntityIndex(id)].m_id = newID;
-			m_entities[GetEntityIndex(id)].m_mask.reset();
-			m_freeEntities.push_back(GetEntityIndex(GetEntityIndex(id)));
+			if (s_componentInfo[componentId].m_hash == hash)
+				return componentId;
 		}
-		
-		template <typename T, typename... Args>
-		T*  Assign(EntityID id, Args&&... args) requires
-			std::is_constructible_v<T>
-			&& (std::is_constructible_v<T, Args...> || std::is_default_constructible_v<T>)
+		return ComponentID(-1);
+	}
+
+	// Sparse set of entity indices. The dense list is split into an active prefix and an
+	// inactive tail so iteration can stop at ActiveCount() and never visit sleeping or disabled entities
+	class EntitySet
+	{
+	public:
+		// Adds the entity index to the active part of the set
+		void Insert(EntityIndex index)
 		{
-			ComponentID componentId = GetId<T>();
+			if (Contains(index))
+				return;
 
-			// Ensures you're not accessing an entity that has been deleted
-			if (m_entities[GetEntityIndex(id)].m_id != id)
-				return nullptr;
+			if (index >= m_sparse.size())
+				m_sparse.resize(index + 1, EntityIndex(-1));
 
-			// Resize the component pool vector if necessary
-			if (componentId >= m_componentPools.size())
-				m_componentPools.resize(componentId + 1, nullptr);
-			
-			if (m_componentPools[componentId] == nullptr)  // New component, make a new pool
-				m_componentPools[componentId] = new ComponentPool(sizeof(T));
+			m_sparse[index] = EntityIndex(m_dense.size());
+			m_dense.push_back(index);
+			Swap(m_sparse[index], EntityIndex(m_activeCount));
+			m_activeCount++;
+		}
 
-			// Looks up the component in the pool and initializes it with placement new
-			if constexpr (std::is_constructible_v<T, Args...>) 
-			{
-				T* comp = new (m_componentPools[componentId]->Get<T>(GetEntityIndex(id))) T(std::forward<Args>(args)...);
-				m_entities[GetEntityIndex(id)].m_mask.set(componentId);
-				return comp;
-			}
-			else if constexpr (std::is_default_constructible_v<T>) 
-			{
-				T* comp = new (m_componentPools[componentId]->Get<T>(GetEntityIndex(id))) T();
-				m_entities[GetEntityIndex(id)].m_mask.set(componentId);
-				return comp;
-			}
-			else
-				return nullptr; // Component type cannot be constructed
+		// Removes the entity index by swapping in the last index of its part of the set
+		void Erase(EntityIndex index)
+		{
+			if (!Contains(index))
+				return;
 
+			Deactivate(index);
+			Swap(m_sparse[index], EntityIndex(m_dense.size() - 1));
+
+			m_sparse[index] = EntityIndex(-1);
+			m_dense.pop_back();
 		}
 
-		template<typename T>
-		void Remove(EntityID id)
+		// Moves the entity index to the inactive tail
+		void Deactivate(EntityIndex index)
 		{
-			// Ensures you're not accessing an entity that has been deleted
-			if (m_entities[GetEntityIndex(id)].m_id != id)
+			if (!Contains(index) || m_sparse[index] >= m_activeCount)
 				return;
 
-			ComponentID componentId = GetId<T>();
-			m_entities[GetEntityIndex(id)].m_mask.reset(componentId);
+			m_activeCount--;
+			Swap(m_sparse[index], EntityIndex(m_activeCount));
 		}
 
-		template <typename T>
-		[[nodiscard]] 
-		T* Get(EntityID id)
+		// Moves the entity index back into the active prefix
+		void Activate(EntityIndex index)
 		{
-			ComponentID componentId = GetId<T>();
-			if (!m_entities[GetEntityIndex(id)].m_mask.test(componentId))
-				return nullptr;
-
-			if (componentId < m_componentPools.size() && m_componentPools[componentId])
-				return m_componentPools[componentId]->Get<T>(GetEntityIndex(id));
+			if (!Contains(index) || m_sparse[index] < m_activeCount)
+				return;
 
-			return nullptr;
+			Swap(m_sparse[index], EntityIndex(m_activeCount));
+			m_activeCount++;
 		}
 
-		template <typename T>
-		bool Has(EntityID id)
+		bool Contains(EntityIndex index) const
 		{
-			return !(Get<T>(id) == nullptr);
+			return index < m_sparse.size() && m_sparse[index] != EntityIndex(-1);
 		}
 
+		size_t Size() const
+		{
+			return m_dense.size();
+		}
 
-		std::vector<EntityDesc>& All()
+		size_t ActiveCount() const
 		{
-			return m_entities;
+			return m_activeCount;
 		}
 
-	private:		
-		std::vector<EntityDesc>     m_entities;        // List of all the entities in a m_rosterPtr
-		std::vector<EntityIndex>    m_freeEntities;    // List of all free entity indices
-		std::vector<ComponentPool*> m_componentPools;  // List of component pools
-	};
+		// Active entity indices first, then inactive ones
+		std::span<const EntityIndex> Entities() const
+		{
+			return m_dense;
+		}
 
-	template <typename... ComponentTypes>
-	class RosterView
-	{
-	public:
-		RosterView(World& roster)
-			:
-			m_rosterPtr(&roster)
+		void Clear()
 		{
-			if (sizeof...(ComponentTypes) == 0)
-			{
-				m_all = true;
-			}
-			else
-			{
-				// Unpack the template parameters into an initializer list
-				ComponentID componentIds[] = { 0, GetId<ComponentTypes>() ... };
+			for (EntityIndex index : m_dense)
+				m_sparse[index] = EntityIndex(-1);
 
-				for (ComponentID componentId : componentIds)
-				{
-					m_componentMask.set(componentId);
-				}
-			}
+			m_dense.clear();
+			m_activeCount = 0;
 		}
 
-		EntityID operator*() const
+		void Reserve(size_t count)
 		{
-			return m_rosterPtr->All()[m_index].m_id;
+			m_dense.reserve(count);
+			if (count > m_sparse.size())
+				m_sparse.resize(count, EntityIndex(-1));
 		}
 
-		bool operator==(const RosterView& other) const
+		void ShrinkToFit()
 		{
-			return m_index == other.m_index || m_index == m_rosterPtr->All().size();
+			size_t used = 0;
+			for (EntityIndex index : m_dense)
+				used = std::max(used, size_t(index) + 1);
+
+			m_sparse.resize(used);
+			m_sparse.shrink_to_fit();
+			m_dense.shrink_to_fit();
 		}
 
-		bool operator!=(const RosterView& other) const
+	private:
+		void Swap(EntityIndex slotA, EntityIndex slotB)
 		{
-			return m_index != other.m_index && m_index != m_rosterPtr->All().size();
+			EntityIndex a = m_dense[slotA];
+			EntityIndex b = m_dense[slotB];
+
+			m_dense[slotA] = b;
+			m_dense[slotB] = a;
+			m_sparse[a] = slotB;
+			m_sparse[b] = slotA;
 		}
 
-		RosterView& operator++()
+	private:
+		TrackedVector<EntityIndex> m_dense{ TrackedAllocator<EntityIndex>("EntitySet::m_dense") };    // Entity indices in the set
+		TrackedVector<EntityIndex> m_sparse{ TrackedAllocator<EntityIndex>("EntitySet::m_sparse") };  // Entity index -> position in m_dense (or -1)
+		size_t                     m_activeCount{ 0 };
+	};
+
+	// Chunked storage for the elements of buffer components that outgrow their inline space.
+	// Runs are handed out in power of two sizes from large chunks and recycled through a free
+	// list per size, so growing buffers neither go to the heap one by one nor scatter across it
+	class BufferArena
+	{
+	public:
+		static constexpr size_t BUFFER_ARENA_CHUNK_SIZE = 64 * 1024;
+		static constexpr size_t BUFFER_ARENA_MIN_RUN    = 16;
+
+		explicit BufferArena(size_t alignment)
+			:
+			m_alignment(std::max(alignment, alignof(void*)))
 		{
-			// Keep going next until valid mask is found
-			do
-			{
-				m_index++;
-			} while (m_index < m_rosterPtr->All().size() && !ValidIndex());
+		}
 
-			return *this;
+		~BufferArena()
+		{
+			ReleaseChunks(m_chunks);
+			ReleaseChunks(m_retired);
 		}
 
-		RosterView begin()
+		BufferArena(const BufferArena&) = delete;
+		BufferArena& operator=(const BufferArena&) = delete;
+
+		// Hands out a run of at least 'bytes' bytes, and rounds 'bytes' up to the run's size
+		void* Allocate(size_t& bytes)
 		{
-			int firstIndex = 0;
-			while (
-				firstIndex < m_rosterPtr->All().size()
-				&& (m_componentMask != (m_componentMask & m_rosterPtr->All()[firstIndex].m_mask)
-					|| !IsEntityValid(m_rosterPtr->All()[firstIndex].m_id)))
+			bytes = RunSize(bytes);
+
+			void*& freeRun = m_freeRuns[std::countr_zero(bytes)];
+			if (freeRun)
+			{
+				void* run = freeRun;
+				freeRun = *static_cast<void**>(run);
+				return run;
+			}
+
+			// Runs bigger than a chunk get a chunk of their own
+			if (bytes > BUFFER_ARENA_CHUNK_SIZE)
+				return NewChunk(bytes);
+
+			if (bytes > m_bumpLeft)
 			{
-				firstIndex++;
+				m_bump = NewChunk(BUFFER_ARENA_CHUNK_SIZE);
+				m_bumpLeft = BUFFER_ARENA_CHUNK_SIZE;
 			}
 
-			return RosterView(*m_rosterPtr, firstIndex, m_componentMask);
+			// Every run is a power of two no smaller than the alignment, so the bump pointer stays aligned
+			void* run = m_bump;
+			m_bump += bytes;
+			m_bumpLeft -= bytes;
+			return run;
 		}
 
-		RosterView end()
+		// Returns a run for reuse by buffers of the same size class
+		void Free(void* run, size_t bytes)
 		{
-			return RosterView(*m_rosterPtr, EntityIndex(m_rosterPtr->All().size()), m_componentMask);
+			void*& freeRun = m_freeRuns[std::countr_zero(RunSize(bytes))];
+			*static_cast<void**>(run) = freeRun;
+			freeRun = run;
 		}
 
-	private:
-		RosterView(World& roster, EntityIndex index, ComponentMask mask) 
-			: 
-			RosterView(roster)
+		// Retires every chunk so live runs can be copied into fresh ones. Until EndCompaction,
+		// runs from before the call must not be freed, they are released with their chunks
+		void BeginCompaction()
 		{
-			m_index = index;
-			m_componentMask = mask;
+			m_retired.insert(m_retired.end(), m_chunks.begin(), m_chunks.end());
+			m_chunks.clear();
+			std::fill(std::begin(m_freeRuns), std::end(m_freeRuns), nullptr);
+			m_bump = nullptr;
+			m_bumpLeft = 0;
 		}
 
-		bool ValidIndex()
+		void EndCompaction()
 		{
-			bool validEntity = IsEntityValid(m_rosterPtr->All()[m_index].m_id);
-			bool validComponentMask = (m_all || m_componentMask == (m_componentMask & m_rosterPtr->All()[m_index].m_mask));
+			ReleaseChunks(m_retired);
+		}
 
-			return validEntity && validComponentMask;
+		// Bytes held in chunks, used or not
+		size_t Capacity() const
+		{
+			size_t capacity = 0;
+			for (const Chunk& chunk : m_chunks)
+				capacity += chunk.m_size;
+			return capacity;
 		}
 
 	private:
+		struct Chunk
+		{
+			std::byte* m_data;
+			size_t     m_size;
+		};
+
+		size_t RunSize(size_t bytes) const
+		{
+			return std::bit_ceil(std::max({ bytes, BUFFER_ARENA_MIN_RUN, m_alignment }));
+		}
+
+		std::byte* NewChunk(size_t size)
+		{
+			NoteAllocation("BufferArena chunk", size);
+			std::byte* data = static_cast<std::byte*>(::operator new(size, std::align_val_t(m_alignment)));
+			m_chunks.push_back({ data, size });
+			return data;
+		}
+
+		void ReleaseChunks(TrackedVector<Chunk>& chunks)
+		{
+			for (Chunk& chunk : chunks)
+				::operator delete(chunk.m_data, std::align_val_t(m_alignment));
+			chunks.clear();
+		}
+
+	private:
+		size_t              m_alignment;
+		TrackedVector<Chunk> m_chunks{ TrackedAllocator<Chunk>("BufferArena::m_chunks") };
+		TrackedVector<Chunk> m_retired{ TrackedAllocator<Chunk>("BufferArena::m_retired") };  // Chunks waiting for the end of a compaction
+		void*               m_freeRuns[64]{};  // Free runs by size class, linked through their first bytes
+		std::byte*          m_bump{ nullptr };  // Next free byte of the newest chunk
+		size_t              m_bumpLeft{ 0 };
+	};
+
+	class World;
+
+	// Variable length component that keeps up to InlineCount elements inside the pool slot.
+	// Longer buffers move their elements to the overflow arena of the pool they live in, so
+	// walking the buffers of many entities touches a few chunks rather than a heap pointer each.
+	// A pool's arena is not synchronized, buffers of one type must not grow on several threads at once
+	template <typename T, size_t InlineCount>
+	class Buffer
+	{
+		static_assert(InlineCount > 0, "Buffers need room for at least one inline element");
+		static_assert(InlineCount <= std::numeric_limits<unsigned int>::max(), "Buffer sizes are kept in 32 bits");
+
+		static constexpr unsigned int INLINE_CAPACITY = static_cast<unsigned int>(InlineCount);
+
+	public:
+		using value_type = T;
+
+		Buffer() = default;
+
+		Buffer(std::initializer_list<T> values)
+		{
+			reserve(values.size());
+			for (const T& value : values)
+				new (data() + m_size++) T(value);
+		}
+
+		// Copies and moves start outside any pool and overflow to the heap, the World binds
+		// them to a pool's arena when they are placed there
+		Buffer(const Buffer& other)
+		{
+			reserve(other.m_size);
+			for (const T& value : other)
+				new (data() + m_size++) T(value);
+		}
+
+		Buffer(Buffer&& other) noexcept
+		{
+			if (other.m_overflow && other.m_arena == nullptr)
+			{
+				m_overflow = std::exchange(other.m_overflow, nullptr);
+				m_capacity = std::exchange(other.m_capacity, INLINE_CAPACITY);
+				m_size = std::exchange(other.m_size, 0);
+			}
+			else
+			{
+				// Arena runs stay with their pool, only the elements move
+				reserve(other.m_size);
+				MoveElements(other.data(), other.m_size, data());
+				m_size = std::exchange(other.m_size, 0);
+			}
+		}
+
+		Buffer& operator=(const Buffer& other)
+		{
+			if (this != &other)
+			{
+				clear();
+				reserve(other.m_size);
+				for (const T& value : other)
+					new (data() + m_size++) T(value);
+			}
+			return *this;
+		}
+
+		Buffer& operator=(Buffer&& other)
+		{
+			if (this == &other)
+				return *this;
+
+			clear();
+
+			// Overflow runs can only change hands within the arena they came from
+			if (other.m_overflow && other.m_arena == m_arena)
+			{
+				Release();
+				m_overflow = std::exchange(other.m_overflow, nullptr);
+				m_capacity = std::exchange(other.m_capacity, INLINE_CAPACITY);
+				m_size = std::exchange(other.m_size, 0);
+			}
+			else
+			{
+				reserve(other.m_size);
+				MoveElements(other.data(), other.m_size, data());
+				m_size = std::exchange(other.m_size, 0);
+			}
+			return *this;
+		}
+
+		~Buffer()
+		{
+			clear();
+			Release();
+		}
+
+		T*       data()           { return m_overflow ? m_overflow : Inline(); }
+		const T* data() const     { return m_overflow ? m_overflow : Inline(); }
+		T*       begin()          { return data(); }
+		T*       end()            { return data() + m_size; }
+		const T* begin() const    { return data(); }
+		const T* end() const      { return data() + m_size; }
+		size_t   size() const     { return m_size; }
+		size_t   capacity() const { return m_capacity; }
+		bool     empty() const    { return m_size == 0; }
+
+		T&       operator[](size_t i)       { return data()[i]; }
+		const T& operator[](size_t i) const { return data()[i]; }
+
+		// Whether the elements are stored in the pool slot itself
+		bool IsInline() const
+		{
+			return m_overflow == nullptr;
+		}
+
+		template <typename... Args>
+		T& emplace_back(Args&&... args)
+		{
+			if (m_size < m_capacity)
+			{
+				T* value = new (data() + m_size) T(std::forward<Args>(args)...);
+				m_size++;
+				return *value;
+			}
+
+			// The arguments may refer to an element, so build the new one before the old ones move
+			size_t capacity = std::max<size_t>(m_capacity * 2, m_size + 1);
+			T* run = AllocateRun(capacity);
+			T* value = new (run + m_size) T(std::forward<Args>(args)...);
+			MoveElements(data(), m_size, run);
+			Release();
+
+			m_overflow = run;
+			m_capacity = Narrow(capacity);
+			m_size++;
+			return *value;
+		}
+
+		void push_back(const T& value)
+		{
+			emplace_back(value);
+		}
+
+		void push_back(T&& value)
+		{
+			emplace_back(std::move(value));
+		}
+
+		void pop_back()
+		{
+			data()[--m_size].~T();
+		}
+
+		void clear()
+		{
+			std::destroy_n(data(), m_size);
+			m_size = 0;
+		}
+
+		void reserve(size_t count)
+		{
+			if (count > m_capacity)
+				Grow(count);
+		}
+
+		void resize(size_t count)
+		{
+			reserve(count);
+			while (m_size > count)
+				pop_back();
+			while (m_size < count)
+				emplace_back();
+		}
+
+	private:
+		friend class World;
+
+		template <typename>
+		friend struct BufferOps;
+
+		T* Inline()
+		{
+			return std::launder(reinterpret_cast<T*>(m_inline));
+		}
+
+		const T* Inline() const
+		{
+			return std::launder(reinterpret_cast<const T*>(m_inline));
+		}
+
+		// Sizes and capacities are kept in 32 bits to keep the buffer small
+		static unsigned int Narrow(size_t count)
+		{
+			assert(count <= std::numeric_limits<unsigned int>::max() && "Buffer too large");
+			return static_cast<unsigned int>(count);
+		}
+
+		// Move-constructs 'count' elements into 'dst' and destroys the originals
+		static void MoveElements(T* src, size_t count, T* dst)
+		{
+			for (size_t i = 0; i < count; i++)
+			{
+				new (dst + i) T(std::move(src[i]));
+				src[i].~T();
+			}
+		}
+
+		// Buffers outside a pool overflow to the heap, pool buffers to the pool's arena
+		T* AllocateRun(size_t& capacity)
+		{
+			if (m_arena == nullptr)
+				return static_cast<T*>(::operator new(capacity * sizeof(T), std::align_val_t(alignof(T))));
+
+			size_t bytes = capacity * sizeof(T);
+			T* run = static_cast<T*>(m_arena->Allocate(bytes));
+			capacity = bytes / sizeof(T);
+			return run;
+		}
+
+		static void FreeRun(BufferArena* arena, T* run, size_t capacity)
+		{
+			if (arena == nullptr)
+				::operator delete(run, std::align_val_t(alignof(T)));
+			else
+				arena->Free(run, capacity * sizeof(T));
+		}
+
+		void Grow(size_t capacity)
+		{
+			T* run = AllocateRun(capacity);
+			MoveElements(data(), m_size, run);
+			Release();
+
+			m_overflow = run;
+			m_capacity = Narrow(capacity);
+		}
+
+		void Release()
+		{
+			if (m_overflow)
+				FreeRun(m_arena, m_overflow, m_capacity);
+
+			m_overflow = nullptr;
+			m_capacity = INLINE_CAPACITY;
+		}
+
+		// Moves a pooled buffer to another slot of its pool, handing its overflow run over as is
+		static void Relocate(void* dst, void* src)
+		{
+			Buffer* from = static_cast<Buffer*>(src);
+			Buffer* to = new (dst) Buffer();
+
+			to->m_arena = from->m_arena;
+			if (from->m_overflow)
+			{
+				to->m_overflow = std::exchange(from->m_overflow, nullptr);
+				to->m_capacity = std::exchange(from->m_capacity, INLINE_CAPACITY);
+			}
+			else
+			{
+				MoveElements(from->Inline(), from->m_size, to->Inline());
+			}
+			to->m_size = std::exchange(from->m_size, 0);
+
+			from->~Buffer();
+		}
+
+		// Moves the buffer's overflow into 'arena', or back inline when it fits there. Called once
+		// the buffer is placed in a pool
+		void Bind(BufferArena* arena)
+		{
+			if (arena == m_arena)
+				return;
+
+			if (m_overflow == nullptr)
+			{
+				m_arena = arena;
+				return;
+			}
+
+			T* oldRun = m_overflow;
+			size_t oldCapacity = m_capacity;
+			BufferArena* oldArena = std::exchange(m_arena, arena);
+
+			if (m_size <= InlineCount)
+			{
+				m_overflow = nullptr;
+				m_capacity = INLINE_CAPACITY;
+				MoveElements(oldRun, m_size, Inline());
+			}
+			else
+			{
+				size_t capacity = m_size;
+				m_overflow = AllocateRun(capacity);
+				m_capacity = Narrow(capacity);
+				assert(m_capacity >= m_size && "Arena run too small for the buffer's elements");
+				MoveElements(oldRun, m_size, m_overflow);
+			}
+
+			FreeRun(oldArena, oldRun, oldCapacity);
+		}
+
+		// Copies the overflow into a run sized to fit, or back inline when it fits there.
+		// Only valid during an arena compaction, the old run is released with its chunk
+		void Compact()
+		{
+			if (m_overflow == nullptr || m_arena == nullptr)
+				return;
+
+			T* oldRun = m_overflow;
+			if (m_size <= InlineCount)
+			{
+				m_overflow = nullptr;
+				m_capacity = INLINE_CAPACITY;
+				MoveElements(oldRun, m_size, Inline());
+				return;
+			}
+
+			size_t capacity = m_size;
+			m_overflow = AllocateRun(capacity);
+			m_capacity = Narrow(capacity);
+			assert(m_capacity >= m_size && "Arena run too small for the buffer's elements");
+			MoveElements(oldRun, m_size, m_overflow);
+		}
+
+	private:
+		alignas(T) std::byte m_inline[InlineCount * sizeof(T)];
+		T*                   m_overflow{ nullptr };  // Elements outside the slot, nullptr while inline
+		BufferArena*         m_arena{ nullptr };     // Arena of the pool the buffer lives in, nullptr outside a pool
+		unsigned int         m_size{ 0 };
+		unsigned int         m_capacity{ INLINE_CAPACITY };
+	};
+
+	template <typename T>
+	struct IsBuffer : std::false_type {};
+
+	template <typename T, size_t InlineCount>
+	struct IsBuffer<Buffer<T, InlineCount>> : std::true_type {};
+
+	template <typename T, size_t InlineCount>
+	struct BufferOps<Buffer<T, InlineCount>>
+	{
+		static void Relocate(void* dst, void* src)
+		{
+			Buffer<T, InlineCount>::Relocate(dst, src);
+		}
+
+		// Defined after ComponentPool
+		static void Bind(void* ptr, ComponentPool* pool);
+	};
+
+	// Stands for any target in a relation pair
+	struct Wildcard {};
+
+	constexpr size_t RELATION_INLINE_TARGETS = 2;  // Targets a relation component keeps inline before overflowing
+
+	// Target list layout shared by every relation component, so relations can be handled without their type
+	using RelationTargets = Buffer<EntityID, RELATION_INLINE_TARGETS>;
+
+	template <typename Relation, typename Target = Wildcard>
+	class Pair;
+
+	// Component an entity owns while it has at least one (Relation, target) pair, holding the
+	// targets. Query it like any component, e.g. RosterView<Pair<Targets, Wildcard>>. Targets are
+	// entities, so Wildcard is the only target type. Pairs change through World::AddPair and
+	// RemovePair, which keep the reverse index behind World::Sources in step
+	template <typename Relation>
+	class Pair<Relation, Wildcard> : private RelationTargets
+	{
+	public:
+		using value_type = EntityID;
+
+		const EntityID* begin() const { return RelationTargets::begin(); }
+		const EntityID* end() const   { return RelationTargets::end(); }
+		size_t          size() const  { return RelationTargets::size(); }
+		bool            empty() const { return RelationTargets::empty(); }
+
+		const EntityID& operator[](size_t i) const
+		{
+			return RelationTargets::operator[](i);
+		}
+
+	private:
+		friend class World;
+	};
+
+	template <typename Relation>
+	struct IsBuffer<Pair<Relation, Wildcard>> : std::true_type {};
+
+	// A relation component is its target list, which sits at the same address
+	template <typename Relation>
+	struct BufferOps<Pair<Relation, Wildcard>> : BufferOps<RelationTargets> {};
+
+	// Stores one component type, indexed by entity index. Storage grows on demand to cover
+	// the highest entity index that owns the component, and the pool owns the lifetime
+	// of every component in it
+	class ComponentPool
+	{
+	public:
+		explicit ComponentPool(const ComponentInfo& info)
+			:
+			m_elementSize(info.m_size),
+			m_alignment(info.m_alignment),
+			m_relocate(info.m_relocate),
+			m_destroy(info.m_destroy)
+		{
+		}
+
+		~ComponentPool()
+		{
+			if (m_destroy)
+			{
+				for (EntityIndex index : m_owners.Entities())
+					m_destroy(Get<std::byte>(index));
+			}
+
+			Free(m_data);
+			Free(m_scratch);
+
+			// Last, buffer components hand their runs back to the arena as they are destroyed
+			delete m_buffers;
+		}
+		
+		ComponentPool() = delete;
+		ComponentPool(const ComponentPool&) = delete;
+		ComponentPool& operator=(const ComponentPool&) = delete;
+		bool operator==(const ComponentPool& other) const = delete;
+
+		template <typename T>
+		T* Get(size_t index)
+		{
+			return reinterpret_cast<T*>(&m_data[index * m_elementSize]);
+		}
+
+		std::byte* Data() const
+		{
+			return m_data;
+		}
+
+		size_t ElementSize() const
+		{
+			return m_elementSize;
+		}
+
+		// Number of entity indices the storage currently covers
+		size_t Capacity() const
+		{
+			return m_capacity;
+		}
+
+		// Overflow arena of a pool of Buffer components, made on first use
+		BufferArena* BufferStorage(size_t alignment)
+		{
+			if (m_buffers == nullptr)
+				m_buffers = new BufferArena(alignment);
+			return m_buffers;
+		}
+
+		// Makes room for the entity's component and adds it to the membership list.
+		// Returns the slot to construct the component in, an existing component is destroyed first
+		void* Emplace(EntityIndex index)
+		{
+			EnsureCapacity(size_t(index) + 1);
+
+			void* slot = Get<std::byte>(index);
+			if (m_owners.Contains(index))
+			{
+				if (m_destroy)
+					m_destroy(slot);
+			}
+			else
+			{
+				m_owners.Insert(index);
+			}
+			return slot;
+		}
+
+		// Like Emplace, but builds the component with construct(slot). When the storage has to
+		// grow, the component is built in the new block before the old one is released, as
+		// std::vector does, and a component being replaced is only destroyed once its successor
+		// is built, so construct may still read components of this pool
+		template <typename Construct>
+		void* Emplace(EntityIndex index, Construct&& construct)
+		{
+			if (size_t(index) >= m_capacity)
+			{
+				size_t capacity = GrownCapacity(size_t(index) + 1);
+				std::byte* data = Allocate(capacity);
+				construct(&data[index * m_elementSize]);
+
+				Adopt(data, capacity);
+				m_owners.Insert(index);
+				return Get<std::byte>(index);
+			}
+
+			void* slot = Get<std::byte>(index);
+			if (m_owners.Contains(index))
+			{
+				// Build aside, then swap the new component in for the old one
+				void* scratch = Scratch();
+				construct(scratch);
+
+				if (m_destroy)
+					m_destroy(slot);
+				Relocate(slot, scratch);
+				return slot;
+			}
+
+			m_owners.Insert(index);
+			construct(slot);
+			return slot;
+		}
+
+		// Destroys the entity's component and removes it from the membership list
+		void Erase(EntityIndex index)
+		{
+			if (!m_owners.Contains(index))
+				return;
+
+			if (m_destroy)
+				m_destroy(Get<std::byte>(index));
+
+			m_owners.Erase(index);
+		}
+
+		// Destroys every component in the pool and empties the membership list, keeping the storage
+		void Clear()
+		{
+			if (m_destroy)
+			{
+				for (EntityIndex index : m_owners.Entities())
+					m_destroy(Get<std::byte>(index));
+			}
+
+			m_owners.Clear();
+		}
+
+		bool Contains(EntityIndex index) const
+		{
+			return m_owners.Contains(index);
+		}
+
+		size_t Size() const
+		{
+			return m_owners.Size();
+		}
+
+		EntitySet& Owners()
+		{
+			return m_owners;
+		}
+
+		const EntitySet& Owners() const
+		{
+			return m_owners;
+		}
+
+		// Grows the storage geometrically until it covers 'count' entity indices
+		void EnsureCapacity(size_t count)
+		{
+			if (count > m_capacity)
+				Reallocate(GrownCapacity(count));
+		}
+
+		// Makes the storage cover at least 'count' entity indices
+		void Reserve(size_t count)
+		{
+			assert(count <= MAX_ENTITIES && "Entity index out of range, increase MAX_ENTITIES");
+			if (count > m_capacity)
+				Reallocate(count);
+
+			m_owners.Reserve(count);
+		}
+
+		// Trims the storage down to the highest entity index that owns the component
+		void ShrinkToFit()
+		{
+			size_t used = 0;
+			for (EntityIndex index : m_owners.Entities())
+				used = std::max(used, size_t(index) + 1);
+
+			if (used < m_capacity)
+				Reallocate(used);
+
+			m_owners.ShrinkToFit();
+		}
+
+	private:
+		std::byte* Allocate(size_t count)
+		{
+			if (count == 0)
+				return nullptr;
+
+			NoteAllocation("ComponentPool storage", count * m_elementSize);
+			return static_cast<std::byte*>(::operator new(count * m_elementSize, std::align_val_t(m_alignment)));
+		}
+
+		void Free(std::byte* data)
+		{
+			if (data)
+				::operator delete(data, std::align_val_t(m_alignment));
+		}
+
+		// Doubles the storage, never past MAX_ENTITIES since no entity index can be beyond it
+		size_t GrownCapacity(size_t count) const
+		{
+			assert(count <= MAX_ENTITIES && "Entity index out of range, increase MAX_ENTITIES");
+			return std::min(std::max({ count, m_capacity * 2, size_t(64) }), MAX_ENTITIES);
+		}
+
+		// Room for one component outside the storage, made on first use
+		void* Scratch()
+		{
+			if (m_scratch == nullptr)
+				m_scratch = Allocate(1);
+			return m_scratch;
+		}
+
+		// Moves the component at 'src' to 'dst', leaving 'src' destroyed
+		void Relocate(void* dst, void* src)
+		{
+			if (m_relocate)
+				m_relocate(dst, src);
+			else
+				std::memcpy(dst, src, m_elementSize);
+		}
+
+		// Moves every owned component into storage for 'capacity' entity indices
+		void Reallocate(size_t capacity)
+		{
+			Adopt(Allocate(capacity), capacity);
+		}
+
+		// Moves every owned component into 'data', which covers 'capacity' entity indices, and releases the old storage
+		void Adopt(std::byte* data, size_t capacity)
+		{
+			if (m_relocate == nullptr)
+			{
+				if (data && m_data)
+					std::memcpy(data, m_data, std::min(capacity, m_capacity) * m_elementSize);
+			}
+			else
+			{
+				for (EntityIndex index : m_owners.Entities())
+					m_relocate(&data[index * m_elementSize], Get<std::byte>(index));
+			}
+
+			Free(m_data);
+			m_data = data;
+			m_capacity = capacity;
+		}
+
+	private:
+		size_t m_elementSize{ 0 };
+		size_t m_alignment{ 0 };
+		size_t m_capacity{ 0 };
+		std::byte* m_data{ nullptr };
+		std::byte* m_scratch{ nullptr };  // One component's worth of storage for replacing components
+		void (*m_relocate)(void* dst, void* src){ nullptr };
+		void (*m_destroy)(void* ptr){ nullptr };
+		EntitySet m_owners;  // Entity indices that own this component
+		BufferArena* m_buffers{ nullptr };  // Overflow storage, only for Buffer components
+	};
+
+	template <typename T, size_t InlineCount>
+	void BufferOps<Buffer<T, InlineCount>>::Bind(void* ptr, ComponentPool* pool)
+	{
+		static_cast<Buffer<T, InlineCount>*>(ptr)->Bind(pool->BufferStorage(alignof(T)));
+	}
+
+	// Order in which destroyed entity slots are handed out again
+	enum class FreeListPolicy
+	{
+		Lifo,         // Reuse the most recently freed slot
+		LowestIndex,  // Reuse the lowest free slot, keeping alive entities packed at the front
+		Fifo          // Reuse the oldest freed slot, delaying version reuse as long as possible
+	};
+
+	class FreeList
+	{
+	public:
+		explicit FreeList(FreeListPolicy policy)
+			:
+			m_policy(policy)
+		{
+		}
+
+		void Push(EntityIndex index)
+		{
+			m_count++;
+			if (m_policy != FreeListPolicy::LowestIndex)
+			{
+				m_indices.push_back(index);
+				return;
+			}
+
+			if (index >= m_levels[0].size() * 64)
+				Grow(index / 64 + 1);
+
+			// Set the index's bit, and mark its word as non-empty in every level above
+			for (size_t level = 0; level < m_levels.size(); level++, index /= 64)
+			{
+				unsigned long long& word = m_levels[level][index / 64];
+				bool wasEmpty = word == 0;
+
+				word |= 1ull << (index % 64);
+				if (!wasEmpty)
+					break;
+			}
+		}
+
+		EntityIndex Pop()
+		{
+			m_count--;
+			switch (m_policy)
+			{
+			case FreeListPolicy::Lifo:
+			{
+				EntityIndex index = m_indices.back();
+				m_indices.pop_back();
+				return index;
+			}
+
+			case FreeListPolicy::Fifo:
+			{
+				EntityIndex index = m_indices[m_head++];
+
+				// Drop the consumed front once it makes up half of the queue
+				if (m_head * 2 >= m_indices.size())
+				{
+					m_indices.erase(m_indices.begin(), m_indices.begin() + m_head);
+					m_head = 0;
+				}
+				return index;
+			}
+
+			default:
+				return PopLowest();
+			}
+		}
+
+		bool Empty() const
+		{
+			return m_count == 0;
+		}
+
+		void ShrinkToFit()
+		{
+			m_indices.shrink_to_fit();
+		}
+
+		size_t Size() const
+		{
+			return m_count;
+		}
+
+	private:
+		// Walks down the bitset levels following the lowest set bit, tzcnt per level
+		EntityIndex PopLowest()
+		{
+			size_t index = 0;
+			for (size_t level = m_levels.size(); level-- > 0;)
+			{
+				index = index * 64 + std::countr_zero(m_levels[level][index]);
+			}
+
+			EntityIndex result = EntityIndex(index);
+
+			// Clear the bit, and the bits above it for every word that became empty
+			for (size_t level = 0; level < m_levels.size(); level++, index /= 64)
+			{
+				unsigned long long& word = m_levels[level][index / 64];
+				word &= ~(1ull << (index % 64));
+				if (word != 0)
+					break;
+			}
+
+			return result;
+		}
+
+		// Resizes the bottom level to 'words' words and rebuilds the levels above it until one word remains
+		void Grow(size_t words)
+		{
+			words = std::max(words, m_levels[0].size() * 2);
+			NoteAllocation("FreeList::Grow", words * sizeof(unsigned long long));
+			m_levels.resize(1);
+			m_levels[0].resize(words, 0);
+
+			while (m_levels.back().size() > 1)
+			{
+				const std::vector<unsigned long long>& below = m_levels.back();
+
+				std::vector<unsigned long long> level((below.size() + 63) / 64, 0);
+				for (size_t word = 0; word < below.size(); word++)
+				{
+					if (below[word] != 0)
+						level[word / 64] |= 1ull << (word % 64);
+				}
+				m_levels.push_back(std::move(level));
+			}
+		}
+
+	private:
+		FreeListPolicy                               m_policy;
+		size_t                                       m_count{ 0 };
+		TrackedVector<EntityIndex>                   m_indices{ TrackedAllocator<EntityIndex>("FreeList::m_indices") };  // Stack or queue of free slots, for Lifo and Fifo
+		size_t                                       m_head{ 0 };  // Front of the queue, for Fifo
+		std::vector<std::vector<unsigned long long>> m_levels{ 1, std::vector<unsigned long long>(1, 0) };  // Hierarchical free bitset, for LowestIndex
+	};
+
+	// Bump allocator for scratch memory that lives until the end of the frame. Allocation moves
+	// an offset forward, and Reset releases everything at once without running destructors.
+	// Blocks are kept across resets, so once warmed up the arena never goes back to malloc
+	class FrameArena
+	{
+	public:
+		static constexpr size_t        FRAME_ARENA_BLOCK_SIZE = 64 * 1024;
+		static constexpr unsigned char FRAME_ARENA_POISON     = 0xCD;
+
+		FrameArena() = default;
+
+		~FrameArena()
+		{
+			for (Block& block : m_blocks)
+				::operator delete(block.m_data);
+		}
+
+		FrameArena(const FrameArena&) = delete;
+		FrameArena& operator=(const FrameArena&) = delete;
+
+		void* Allocate(size_t size, size_t alignment = alignof(std::max_align_t))
+		{
+			while (true)
+			{
+				if (m_current == m_blocks.size())
+				{
+					// Room for the padding too, so the allocation fits whatever the block's alignment
+					size_t blockSize = std::max(FRAME_ARENA_BLOCK_SIZE, size + alignment);
+					NoteAllocation("FrameArena block", blockSize);
+					m_blocks.push_back({ static_cast<std::byte*>(::operator new(blockSize)), blockSize, 0 });
+				}
+
+				Block& block = m_blocks[m_current];
+				size_t padding = size_t(-reinterpret_cast<uintptr_t>(block.m_data + m_offset)) & (alignment - 1);
+				if (m_offset + padding + size <= block.m_size)
+				{
+					void* data = block.m_data + m_offset + padding;
+					m_offset += padding + size;
+					return data;
+				}
+
+				// Move on to the next block, the tail of this one stays unused until the reset
+				block.m_used = m_offset;
+				m_current++;
+				m_offset = 0;
+			}
+		}
+
+		// Uninitialized storage for 'count' objects of a type that needs no destructor
+		template <typename T>
+		T* Allocate(size_t count)
+		{
+			static_assert(std::is_trivially_destructible_v<T>, "Frame arena memory is released without running destructors");
+			return static_cast<T*>(Allocate(count * sizeof(T), alignof(T)));
+		}
+
+		// Releases every allocation. Pointers handed out before must not be used afterwards
+		void Reset()
+		{
+#if ECS_ARENA_POISON
+			for (size_t i = 0; i < m_blocks.size() && i <= m_current; i++)
+			{
+				size_t used = i == m_current ? m_offset : m_blocks[i].m_used;
+				std::memset(m_blocks[i].m_data, FRAME_ARENA_POISON, used);
+			}
+#endif
+			m_current = 0;
+			m_offset = 0;
+		}
+
+		// Bytes held by the arena, used or not
+		size_t Capacity() const
+		{
+			size_t capacity = 0;
+			for (const Block& block : m_blocks)
+				capacity += block.m_size;
+			return capacity;
+		}
+
+	private:
+		struct Block
+		{
+			std::byte* m_data;
+			size_t     m_size;
+			size_t     m_used;  // End of the last allocation, recorded once the arena moves past the block
+		};
+
+		TrackedVector<Block> m_blocks{ TrackedAllocator<Block>("FrameArena::m_blocks") };
+		size_t             m_current{ 0 };  // Block being allocated from
+		size_t             m_offset{ 0 };   // Next free byte in the current block
+	};
+
+	// Standard allocator over a frame arena, for containers that only live during the frame.
+	// Deallocation is a no-op, the memory comes back when the arena is reset
+	template <typename T>
+	class ScratchAllocator
+	{
+	public:
+		using value_type = T;
+
+		ScratchAllocator(FrameArena& arena)
+			:
+			m_arena(&arena)
+		{
+		}
+
+		template <typename U>
+		ScratchAllocator(const ScratchAllocator<U>& other)
+			:
+			m_arena(other.m_arena)
+		{
+		}
+
+		T* allocate(size_t count)
+		{
+			return static_cast<T*>(m_arena->Allocate(count * sizeof(T), alignof(T)));
+		}
+
+		void deallocate(T*, size_t)
+		{
+		}
+
+		template <typename U>
+		bool operator==(const ScratchAllocator<U>& other) const
+		{
+			return m_arena == other.m_arena;
+		}
+
+	private:
+		template <typename U>
+		friend class ScratchAllocator;
+
+		FrameArena* m_arena;
+	};
+
+	template <typename T>
+	using ScratchVector = std::vector<T, ScratchAllocator<T>>;
+
+	// Splits a pointer to data member into its class and member types
+	template <typename T>
+	struct MemberPointerTraits;
+
+	template <typename C, typename V>
+	struct MemberPointerTraits<V C::*>
+	{
+		using Class = C;
+		using Value = V;
+	};
+
+	// Type Sum accumulates a field in by default, wide enough that large worlds do not overflow it:
+	// long long or unsigned long long for integers, at least double for floating point, and the
+	// field's own type for anything else
+	template <typename Value>
+	struct SumOf
+	{
+		using Type = Value;
+	};
+
+	template <typename Value> requires std::is_integral_v<Value>
+	struct SumOf<Value>
+	{
+		using Type = std::conditional_t<std::is_signed_v<Value>, long long, unsigned long long>;
+	};
+
+	template <typename Value> requires std::is_floating_point_v<Value>
+	struct SumOf<Value>
+	{
+		using Type = std::common_type_t<Value, double>;
+	};
+
+	enum class IndexKind
+	{
+		Hash,    // Exact lookups in O(1)
+		Sorted,  // Exact lookups in O(log n), plus range lookups
+		Summary  // Min and max per chunk of entities, lets Where clauses skip whole chunks
+	};
+
+	// Secondary index over a component field, mapping field values to the entities whose
+	// component holds them. World keeps it in step with the pool: entries follow components
+	// being assigned and removed, and mutable access marks the entity dirty so its key is
+	// rechecked on the next lookup. Every owner is indexed, including disabled and sleeping ones
+	class FieldIndexBase
+	{
+	public:
+		FieldIndexBase(ComponentID componentId, ComponentPool* pool, const void* field)
+			:
+			m_componentId(componentId),
+			m_pool(pool),
+			m_field(field)
+		{
+		}
+
+		virtual ~FieldIndexBase() = default;
+
+		FieldIndexBase(const FieldIndexBase&) = delete;
+		FieldIndexBase& operator=(const FieldIndexBase&) = delete;
+
+		// Indexes the entity under the current value of its component, or re-keys it
+		virtual void Insert(EntityIndex index) = 0;
+		virtual void Erase(EntityIndex index) = 0;
+		virtual void Clear() = 0;
+
+		// Entities keyed by *key, which points to a value of the field's type
+		virtual std::span<const EntityIndex> Lookup(const void* key) = 0;
+
+		// Appends the entities keyed by values in [*low, *high], only sorted indices support this
+		virtual void LookupRange(const void* low, const void* high, TrackedVector<EntityIndex>& out) = 0;
+
+		// Whether the chunk may hold an entity with a value in [*low, *high], only summaries ever rule one out
+		virtual bool ChunkMayMatch(size_t chunk, const void* low, const void* high) const
+		{
+			(void)chunk, (void)low, (void)high;
+			return true;
+		}
+
+		// Brings the index up to date with every entity marked dirty since the last refresh
+		virtual void Refresh()
+		{
+			if (!m_anyDirty.exchange(false, std::memory_order_relaxed))
+				return;
+
+			for (size_t word = 0; word < m_dirtyWords / 64; word++)
+			{
+				unsigned long long bits = m_dirty[word].exchange(0, std::memory_order_relaxed);
+				while (bits)
+				{
+					Recheck(EntityIndex(word * 64 + std::countr_zero(bits)));
+					bits &= bits - 1;
+				}
+			}
+		}
+
+		// Safe to call from several threads at once, as mutable Get may be
+		void MarkDirty(EntityIndex index)
+		{
+			if (index >= m_dirtyWords)
+				return;
+
+			m_dirty[index / 64].fetch_or(1ull << (index % 64), std::memory_order_relaxed);
+			m_anyDirty.store(true, std::memory_order_relaxed);
+		}
+
+		ComponentID GetComponentId() const
+		{
+			return m_componentId;
+		}
+
+		// Identifies the indexed field, one address per pointer to member
+		const void* FieldTag() const
+		{
+			return m_field;
+		}
+
+	protected:
+		// Updates one dirty entity during Refresh
+		virtual void Recheck(EntityIndex index) = 0;
+
+		// Makes room in the dirty bits for 'index', only called during structural changes
+		void TrackDirty(EntityIndex index)
+		{
+			if (index < m_dirtyWords)
+				return;
+
+			size_t words = std::max<size_t>(index / 64 + 1, m_dirtyWords / 64 * 2);
+			NoteAllocation("FieldIndexBase::m_dirty", words * sizeof(unsigned long long));
+
+			std::unique_ptr<std::atomic<unsigned long long>[]> dirty(new std::atomic<unsigned long long>[words]);
+			for (size_t word = 0; word < words; word++)
+				dirty[word].store(word < m_dirtyWords / 64 ? m_dirty[word].load(std::memory_order_relaxed) : 0, std::memory_order_relaxed);
+
+			m_dirty = std::move(dirty);
+			m_dirtyWords = words * 64;
+		}
+
+	protected:
+		ComponentID    m_componentId;
+		ComponentPool* m_pool;
+		const void*    m_field;
+
+	private:
+		std::unique_ptr<std::atomic<unsigned long long>[]> m_dirty;  // One bit per entity index
+		size_t                                             m_dirtyWords{ 0 };  // Entity indices covered by m_dirty
+		std::atomic<bool>                                  m_anyDirty{ false };
+	};
+
+	// Unique address for each indexed field
+	template <auto Field>
+	inline constexpr char s_indexedField = 0;
+
+	// Unique address for each summarized field, apart from its index so a field can have both
+	template <auto Field>
+	inline constexpr char s_summarizedField = 0;
+
+	// Tag the field's index of 'Kind' is registered under
+	template <auto Field, IndexKind Kind>
+	inline constexpr const void* s_indexTag = Kind == IndexKind::Summary ? &s_summarizedField<Field> : &s_indexedField<Field>;
+
+	template <auto Field, IndexKind Kind>
+	class FieldIndex : public FieldIndexBase
+	{
+		using Component = typename MemberPointerTraits<decltype(Field)>::Class;
+		using Value     = typename MemberPointerTraits<decltype(Field)>::Value;
+		using Entities  = TrackedVector<EntityIndex>;
+		using Node      = TrackedAllocator<std::pair<const Value, Entities>>;
+		using Map       = std::conditional_t<Kind == IndexKind::Hash,
+			std::unordered_map<Value, Entities, std::hash<Value>, std::equal_to<Value>, Node>,
+			std::map<Value, Entities, std::less<Value>, Node>>;
+
+		// Where an entity sits in the index, so it can be removed in O(1)
+		struct Entry
+		{
+			std::optional<Value> m_key;
+			size_t               m_slot{ 0 };
+		};
+
+	public:
+		FieldIndex(ComponentID componentId, ComponentPool* pool)
+			:
+			FieldIndexBase(componentId, pool, &s_indexedField<Field>)
+		{
+			for (EntityIndex index : pool->Owners().Entities())
+				Insert(index);
+		}
+
+		void Insert(EntityIndex index) override
+		{
+			const Value& key = m_pool->template Get<Component>(index)->*Field;
+			if (index < m_entries.size() && m_entries[index].m_key && *m_entries[index].m_key == key)
+				return;
+
+			Erase(index);
+			TrackDirty(index);
+			if (index >= m_entries.size())
+				m_entries.resize(size_t(index) + 1);
+
+			Entities& entities = m_entities.try_emplace(key, TrackedAllocator<EntityIndex>("FieldIndex entities")).first->second;
+			m_entries[index] = { key, entities.size() };
+			entities.push_back(index);
+		}
+
+		void Erase(EntityIndex index) override
+		{
+			if (index >= m_entries.size() || !m_entries[index].m_key)
+				return;
+
+			// Swap the last entity with this key into the freed slot
+			auto found = m_entities.find(*m_entries[index].m_key);
+			Entities& entities = found->second;
+			EntityIndex last = entities.back();
+			entities[m_entries[index].m_slot] = last;
+			m_entries[last].m_slot = m_entries[index].m_slot;
+			entities.pop_back();
+
+			if (entities.empty())
+				m_entities.erase(found);
+			m_entries[index].m_key.reset();
+		}
+
+		void Clear() override
+		{
+			m_entities.clear();
+			m_entries.clear();
+		}
+
+		std::span<const EntityIndex> Lookup(const void* key) override
+		{
+			Refresh();
+
+			auto found = m_entities.find(*static_cast<const Value*>(key));
+			if (found == m_entities.end())
+				return {};
+			return found->second;
+		}
+
+		void LookupRange(const void* low, const void* high, TrackedVector<EntityIndex>& out) override
+		{
+			if constexpr (Kind == IndexKind::Sorted)
+			{
+				Refresh();
+
+				auto last = m_entities.upper_bound(*static_cast<const Value*>(high));
+				for (auto it = m_entities.lower_bound(*static_cast<const Value*>(low)); it != last; ++it)
+					out.insert(out.end(), it->second.begin(), it->second.end());
+			}
+			else
+			{
+				assert(false && "Range lookups need a sorted index");
+			}
+		}
+
+	protected:
+		void Recheck(EntityIndex index) override
+		{
+			if (m_pool->Contains(index))
+				Insert(index);
+		}
+
+	private:
+		Map                  m_entities{ Node("FieldIndex::m_entities") };            // Field value -> entities holding it
+		TrackedVector<Entry> m_entries{ TrackedAllocator<Entry>("FieldIndex::m_entries") };  // Entity index -> its key and slot
+	};
+
+	// Smallest and largest value of a numeric field in each chunk of SUMMARY_CHUNK_SIZE entity
+	// indices, like the zone maps of a columnar database. Writes only mark chunks stale, they
+	// are recomputed when a Where query starts. Bounds cover disabled and sleeping entities too
+	template <auto Field>
+	class FieldSummary : public FieldIndexBase
+	{
+		using Component = typename MemberPointerTraits<decltype(Field)>::Class;
+		using Value     = typename MemberPointerTraits<decltype(Field)>::Value;
+
+		static_assert(std::is_arithmetic_v<Value>, "Summaries need a numeric field");
+
+	public:
+		FieldSummary(ComponentID componentId, ComponentPool* pool)
+			:
+			FieldIndexBase(componentId, pool, &s_summarizedField<Field>)
+		{
+			for (EntityIndex index : pool->Owners().Entities())
+				Insert(index);
+		}
+
+		void Insert(EntityIndex index) override
+		{
+			TrackDirty(index);
+			MarkDirty(index);
+		}
+
+		void Erase(EntityIndex index) override
+		{
+			MarkDirty(index);
+		}
+
+		void Clear() override
+		{
+			std::fill(m_min.begin(), m_min.end(), std::numeric_limits<Value>::max());
+			std::fill(m_max.begin(), m_max.end(), std::numeric_limits<Value>::lowest());
+		}
+
+		std::span<const EntityIndex> Lookup(const void*) override
+		{
+			assert(false && "Summaries only prune Where clauses, Find needs a hash or sorted index");
+			return {};
+		}
+
+		void LookupRange(const void*, const void*, TrackedVector<EntityIndex>&) override
+		{
+			assert(false && "Summaries only prune Where clauses, FindRange needs a sorted index");
+		}
+
+		bool ChunkMayMatch(size_t chunk, const void* low, const void* high) const override
+		{
+			// No entity of the chunk has ever owned the component
+			if (chunk >= m_min.size())
+				return false;
+
+			return !(m_max[chunk] < *static_cast<const Value*>(low) || *static_cast<const Value*>(high) < m_min[chunk]);
+		}
+
+		void Refresh() override
+		{
+			FieldIndexBase::Refresh();
+
+			for (size_t chunk : m_staleChunks)
+			{
+				Value min = std::numeric_limits<Value>::max();
+				Value max = std::numeric_limits<Value>::lowest();
+
+				size_t last = std::min((chunk + 1) * SUMMARY_CHUNK_SIZE, m_pool->Capacity());
+				for (size_t index = chunk * SUMMARY_CHUNK_SIZE; index < last; index++)
+				{
+					if (m_pool->Contains(EntityIndex(index)))
+					{
+						Value value = m_pool->template Get<Component>(index)->*Field;
+						min = std::min(min, value);
+						max = std::max(max, value);
+					}
+				}
+
+				m_min[chunk] = min;
+				m_max[chunk] = max;
+				m_stale[chunk] = false;
+			}
+			m_staleChunks.clear();
+		}
+
+	protected:
+		void Recheck(EntityIndex index) override
+		{
+			size_t chunk = index / SUMMARY_CHUNK_SIZE;
+			if (chunk >= m_min.size())
+			{
+				m_min.resize(chunk + 1, std::numeric_limits<Value>::max());
+				m_max.resize(chunk + 1, std::numeric_limits<Value>::lowest());
+				m_stale.resize(chunk + 1, false);
+			}
+
+			if (!m_stale[chunk])
+			{
+				m_stale[chunk] = true;
+				m_staleChunks.push_back(chunk);
+			}
+		}
+
+	private:
+		TrackedVector<Value>         m_min{ TrackedAllocator<Value>("FieldSummary::m_min") };                    // Per chunk
+		TrackedVector<Value>         m_max{ TrackedAllocator<Value>("FieldSummary::m_max") };                    // Per chunk
+		TrackedVector<unsigned char> m_stale{ TrackedAllocator<unsigned char>("FieldSummary::m_stale") };        // Per chunk, whether it waits in m_staleChunks
+		TrackedVector<size_t>        m_staleChunks{ TrackedAllocator<size_t>("FieldSummary::m_staleChunks") };
+	};
+
+	template <typename Relation>
+	inline constexpr char s_relationTag = 0;
+
+	// Reverse index of one relation, from each target to the entities that have a pair with it.
+	// Edges follow the relation component: they are added when a component with targets is placed,
+	// as clones are, and dropped with the component
+	class RelationIndex : public FieldIndexBase
+	{
+	public:
+		using Sources = TrackedVector<EntityIndex>;
+
+		RelationIndex(ComponentID componentId, ComponentPool* pool, const void* tag)
+			:
+			FieldIndexBase(componentId, pool, tag)
+		{
+			for (EntityIndex index : pool->Owners().Entities())
+				Insert(index);
+		}
+
+		void Insert(EntityIndex source) override
+		{
+			for (EntityID target : *m_pool->Get<RelationTargets>(source))
+				AddEdge(source, GetEntityIndex(target));
+		}
+
+		void Erase(EntityIndex source) override
+		{
+			if (!m_pool->Contains(source))
+				return;
+
+			for (EntityID target : *m_pool->Get<RelationTargets>(source))
+				RemoveEdge(source, GetEntityIndex(target));
+		}
+
+		void Clear() override
+		{
+			m_sources.clear();
+		}
+
+		std::span<const EntityIndex> Lookup(const void* key) override
+		{
+			auto found = m_sources.find(*static_cast<const EntityIndex*>(key));
+			if (found == m_sources.end())
+				return {};
+			return found->second;
+		}
+
+		void LookupRange(const void*, const void*, TrackedVector<EntityIndex>&) override
+		{
+			assert(false && "Relations have no range lookups");
+		}
+
+		void AddEdge(EntityIndex source, EntityIndex target)
+		{
+			m_sources.try_emplace(target, TrackedAllocator<EntityIndex>("RelationIndex sources")).first->second.push_back(source);
+		}
+
+		// Linear in the target's sources, edges carry no position
+		void RemoveEdge(EntityIndex source, EntityIndex target)
+		{
+			auto found = m_sources.find(target);
+			if (found == m_sources.end())
+				return;
+
+			Sources& sources = found->second;
+			auto edge = std::find(sources.begin(), sources.end(), source);
+			if (edge != sources.end())
+			{
+				*edge = sources.back();
+				sources.pop_back();
+			}
+
+			if (sources.empty())
+				m_sources.erase(found);
+		}
+
+		// Removes and returns every source of the target
+		Sources TakeSources(EntityIndex target)
+		{
+			auto found = m_sources.find(target);
+			if (found == m_sources.end())
+				return Sources(TrackedAllocator<EntityIndex>("RelationIndex sources"));
+
+			Sources sources = std::move(found->second);
+			m_sources.erase(found);
+			return sources;
+		}
+
+	protected:
+		// Targets can only change through the World, mutable access leaves nothing to recheck
+		void Recheck(EntityIndex) override
+		{
+		}
+
+	private:
+		using Node = TrackedAllocator<std::pair<const EntityIndex, Sources>>;
+
+		std::unordered_map<EntityIndex, Sources, std::hash<EntityIndex>, std::equal_to<EntityIndex>, Node> m_sources{ Node("RelationIndex::m_sources") };  // Target -> sources
+	};
+
+	inline std::atomic<unsigned long long> s_worldCounter{ 0 };
+
+	class DynamicQuery;
+
+	class World
+	{
+	private:
+		// Contains the entity's id and component mask
+		struct EntityDesc
+		{
+			EntityID m_id;
+			ComponentMask m_mask;
+		};
+
+		// Read-only view of the entity table that assembles each EntityDesc from the parallel arrays
+		class EntityTable
+		{
+		public:
+			// Yields a reference to the EntityDesc it assembled, so loops over All() can bind auto&
+			class Iterator
+			{
+			public:
+				const EntityDesc& operator*() const
+				{
+					m_desc = EntityTable(m_world)[m_index];
+					return m_desc;
+				}
+
+				Iterator& operator++()
+				{
+					++m_index;
+					return *this;
+				}
+
+				bool operator!=(const Iterator& other) const
+				{
+					return m_index != other.m_index;
+				}
+
+			private:
+				friend class EntityTable;
+				Iterator(const World* world, size_t index) : m_world(world), m_index(index) {}
+
+				const World*       m_world;
+				size_t             m_index;
+				mutable EntityDesc m_desc{};
+			};
+
+			Iterator begin() const
+			{
+				return Iterator(m_world, 0);
+			}
+
+			Iterator end() const
+			{
+				return Iterator(m_world, size());
+			}
+
+			size_t size() const
+			{
+				return m_world->m_versions.size();
+			}
+
+			EntityDesc operator[](size_t index) const
+			{
+				// Destroyed slots report an invalid index, like the IDs they used to store
+				EntityIndex idIndex = m_world->m_alive.Contains(EntityIndex(index)) ? EntityIndex(index) : EntityIndex(-1);
+				return { CreateEntityId(idIndex, m_world->m_versions[index]), m_world->m_masks[index] };
+			}
+
+		private:
+			friend class World;
+			explicit EntityTable(const World* world) : m_world(world) {}
+
+			const World* m_world;
+		};
+
+	public:
+		// Entities found through a secondary index. Valid until the world changes structurally
+		// or the index is looked up again
+		class IndexMatches
+		{
+		public:
+			class Iterator
+			{
+			public:
+				EntityID operator*() const
+				{
+					return m_world->GetEntityId(*m_index);
+				}
+
+				Iterator& operator++()
+				{
+					++m_index;
+					return *this;
+				}
+
+				bool operator!=(const Iterator& other) const
+				{
+					return m_index != other.m_index;
+				}
+
+			private:
+				friend class IndexMatches;
+				Iterator(const World* world, const EntityIndex* index) : m_world(world), m_index(index) {}
+
+				const World*       m_world;
+				const EntityIndex* m_index;
+			};
+
+			Iterator begin() const
+			{
+				return Iterator(m_world, m_indices.data());
+			}
+
+			Iterator end() const
+			{
+				return Iterator(m_world, m_indices.data() + m_indices.size());
+			}
+
+			size_t size() const
+			{
+				return m_indices.size();
+			}
+
+			bool empty() const
+			{
+				return m_indices.empty();
+			}
+
+		private:
+			friend class World;
+			IndexMatches(const World* world, std::span<const EntityIndex> indices) : m_world(world), m_indices(indices) {}
+
+			const World*                 m_world;
+			std::span<const EntityIndex> m_indices;
+		};
+
+		explicit World(FreeListPolicy freeListPolicy = FreeListPolicy::Lifo)
+			:
+			m_freeEntities(freeListPolicy),
+			m_serial(++s_worldCounter)
+		{
+		}
+
+		~World()
+		{
+			for (FieldIndexBase* index : m_fieldIndices)
+				delete index;
+
+			for (ComponentPool* pool : m_componentPools)
+				delete pool;
+		}
+
+		World(const World&) = delete;
+		World& operator=(const World&) = delete;
+
+		// Sizes the entity table for 'count' entities up front, so loading does not grow it piecemeal
+		void Reserve(size_t count)
+		{
+			m_versions.reserve(count);
+			m_masks.reserve(count);
+			m_awakePerChunk.reserve((count + DORMANT_CHUNK_SIZE - 1) / DORMANT_CHUNK_SIZE);
+			m_alive.Reserve(count);
+		}
+
+		// Sizes the component's pool for 'count' entities. Pools are indexed by entity index,
+		// so this covers entity indices below 'count'
+		template <typename T>
+		void ReserveComponent(size_t count)
+		{
+			m_structuralVersion++;
+			EnsurePool(GetId<T>())->Reserve(count);
+		}
+
+		// Releases the spare capacity of the entity table and every pool, typically after loading
+		void ShrinkToFit()
+		{
+			m_structuralVersion++;
+
+			m_versions.shrink_to_fit();
+			m_masks.shrink_to_fit();
+			m_awakePerChunk.shrink_to_fit();
+			m_alive.ShrinkToFit();
+			m_freeEntities.ShrinkToFit();
+
+			for (ComponentPool* pool : m_componentPools)
+			{
+				if (pool)
+					pool->ShrinkToFit();
+			}
+		}
+
+		// Builds a secondary index over a component field, e.g. CreateIndex<&Team::m_id>().
+		// The index is kept up to date from then on, creating it twice does nothing.
+		// A field can have a Summary for Where next to one Hash or Sorted index for Find
+		template <auto Field, IndexKind Kind = IndexKind::Hash>
+		void CreateIndex()
+		{
+			if (FieldIndexBase* existing = FindIndex(s_indexTag<Field, Kind>))
+			{
+				assert((Kind == IndexKind::Summary || dynamic_cast<FieldIndex<Field, Kind>*>(existing)) && "The field already has an index of the other kind");
+				return;
+			}
+
+			using Component = typename MemberPointerTraits<decltype(Field)>::Class;
+			ComponentID componentId = GetId<Component>();
+
+			if constexpr (Kind == IndexKind::Summary)
+				m_fieldIndices.push_back(new FieldSummary<Field>(componentId, EnsurePool(componentId)));
+			else
+				m_fieldIndices.push_back(new FieldIndex<Field, Kind>(componentId, EnsurePool(componentId)));
+			m_indexedComponents.set(componentId);
+		}
+
+		// Drops the field's Hash or Sorted index, or its summary when Kind is Summary
+		template <auto Field, IndexKind Kind = IndexKind::Hash>
+		void DropIndex()
+		{
+			FieldIndexBase* index = FindIndex(s_indexTag<Field, Kind>);
+			if (index == nullptr)
+				return;
+
+			m_fieldIndices.erase(std::find(m_fieldIndices.begin(), m_fieldIndices.end(), index));
+			delete index;
+
+			ComponentID componentId = GetId<typename MemberPointerTraits<decltype(Field)>::Class>();
+			m_indexedComponents.reset(componentId);
+			for (FieldIndexBase* other : m_fieldIndices)
+			{
+				if (other->GetComponentId() == componentId)
+					m_indexedComponents.set(componentId);
+			}
+		}
+
+		// The field's index made by CreateIndex, or nullptr. Hash and Sorted look up the same index
+		template <auto Field, IndexKind Kind = IndexKind::Hash>
+		FieldIndexBase* GetIndex() const
+		{
+			return FindIndex(s_indexTag<Field, Kind>);
+		}
+
+		// Entities whose component field equals 'value', through the index made by CreateIndex
+		template <auto Field>
+		IndexMatches Find(const typename MemberPointerTraits<decltype(Field)>::Value& value)
+		{
+			FieldIndexBase* index = FindIndex(&s_indexedField<Field>);
+			assert(index && "Find needs an index made with CreateIndex");
+
+			return IndexMatches(this, index ? index->Lookup(&value) : std::span<const EntityIndex>());
+		}
+
+		// Entities whose component field lies in [low, high], needs a sorted index
+		template <auto Field>
+		std::vector<EntityID> FindRange(const typename MemberPointerTraits<decltype(Field)>::Value& low, const typename MemberPointerTraits<decltype(Field)>::Value& high)
+		{
+			FieldIndexBase* index = FindIndex(&s_indexedField<Field>);
+			assert(index && "FindRange needs an index made with CreateIndex");
+
+			TrackedVector<EntityIndex> indices{ TrackedAllocator<EntityIndex>("World::FindRange") };
+			if (index)
+				index->LookupRange(&low, &high, indices);
+
+			std::vector<EntityID> ids;
+			NoteAllocation("World::FindRange result", indices.size() * sizeof(EntityID));
+			ids.reserve(indices.size());
+			for (EntityIndex entity : indices)
+				ids.push_back(GetEntityId(entity));
+			return ids;
+		}
+
+		// Adds the (Relation, target) pair to 'source', giving it a Pair<Relation, Wildcard>
+		// component if it has none. Returns false for stale IDs and pairs it already has
+		template <typename Relation>
+		bool AddPair(EntityID source, EntityID target)
+		{
+			if (!IsCurrent(source) || !IsCurrent(target) || HasPair<Relation>(source, target))
+				return false;
+
+			using Component = Pair<Relation, Wildcard>;
+			RelationIndex* relation = EnsureRelation<Relation>();
+
+			ComponentPool* pool = GetPool(GetId<Component>());
+			Component* pair = pool->Contains(GetEntityIndex(source)) ? pool->template Get<Component>(GetEntityIndex(source)) : Assign<Component>(source);
+			pair->push_back(target);
+			relation->AddEdge(GetEntityIndex(source), GetEntityIndex(target));
+
+			m_structuralVersion++;
+			return true;
+		}
+
+		// Removes the pair, and the relation component with the entity's last pair of the relation
+		template <typename Relation>
+		void RemovePair(EntityID source, EntityID target)
+		{
+			using Component = Pair<Relation, Wildcard>;
+			if (!HasPair<Relation>(source, target))
+				return;
+
+			Component* pair = GetPool(GetId<Component>())->template Get<Component>(GetEntityIndex(source));
+			RemoveTarget(FindRelation(GetId<Component>()), GetEntityIndex(source), *pair, target);
+			if (pair->empty())
+				Remove<Component>(source);
+
+			m_structuralVersion++;
+		}
+
+		template <typename Relation>
+		bool HasPair(EntityID source, EntityID target) const
+		{
+			std::span<const EntityID> targets = Targets<Relation>(source);
+			return std::find(targets.begin(), targets.end(), target) != targets.end();
+		}
+
+		// Targets of the entity's Relation pairs
+		template <typename Relation>
+		std::span<const EntityID> Targets(EntityID source) const
+		{
+			using Component = Pair<Relation, Wildcard>;
+
+			const ComponentPool* pool = GetPool(GetId<Component>());
+			if (!IsCurrent(source) || pool == nullptr || !pool->Contains(GetEntityIndex(source)))
+				return {};
+
+			const Component* pair = const_cast<ComponentPool*>(pool)->template Get<Component>(GetEntityIndex(source));
+			return std::span<const EntityID>(pair->begin(), pair->size());
+		}
+
+		// Entities that have a (Relation, target) pair, in time proportional to their number
+		template <typename Relation>
+		IndexMatches Sources(EntityID target)
+		{
+			RelationIndex* relation = static_cast<RelationIndex*>(FindIndex(&s_relationTag<Relation>));
+			if (relation == nullptr || !IsCurrent(target))
+				return IndexMatches(this, {});
+
+			EntityIndex index = GetEntityIndex(target);
+			return IndexMatches(this, relation->Lookup(&index));
+		}
+
+		// Repacks the overflow elements of every Buffer component of type B into fresh chunks in
+		// entity order, and moves buffers that shrank back into their pool slots. Pointers to
+		// buffer elements do not survive this, typically run after loading or between levels
+		template <typename B>
+		void CompactBuffers() requires IsBuffer<B>::value
+		{
+			ComponentPool* pool = GetPool(GetId<B>());
+			if (pool == nullptr)
+				return;
+
+			BufferArena* arena = pool->BufferStorage(alignof(typename B::value_type));
+			arena->BeginCompaction();
+			for (size_t index = 0; index < pool->Capacity(); index++)
+			{
+				if (pool->Contains(EntityIndex(index)))
+					pool->Get<B>(index)->Compact();
+			}
+			arena->EndCompaction();
+		}
+
+		// The calling thread's frame arena for scratch memory. Everything taken from it is
+		// released by the next EndFrame, so nothing allocated there may outlive the frame
+		FrameArena& ScratchArena()
+		{
+			// Threads remember their arena for the world they last used, so only the first
+			// request from a thread takes the lock. The serial tells apart worlds that reuse an address
+			thread_local unsigned long long t_worldSerial = 0;
+			thread_local FrameArena*        t_arena = nullptr;
+			if (t_worldSerial == m_serial)
+				return *t_arena;
+
+			std::lock_guard<std::mutex> lock(m_arenaMutex);
+
+			std::thread::id thread = std::this_thread::get_id();
+			auto found = std::find(m_arenaThreads.begin(), m_arenaThreads.end(), thread);
+			if (found == m_arenaThreads.end())
+			{
+				NoteAllocation("World::ScratchArena", sizeof(FrameArena));
+				m_arenaThreads.push_back(thread);
+				m_arenas.emplace_back();
+				found = m_arenaThreads.end() - 1;
+			}
+
+			t_worldSerial = m_serial;
+			t_arena = &m_arenas[found - m_arenaThreads.begin()];
+			return *t_arena;
+		}
+
+		// Resets every thread's frame arena. Call once per frame, after the systems are done
+		void EndFrame()
+		{
+			std::lock_guard<std::mutex> lock(m_arenaMutex);
+			for (FrameArena& arena : m_arenas)
+				arena.Reset();
+		}
+
+		[[maybe_unused]] 
+		EntityID NewEntity()
+		{
+			m_structuralVersion++;
+
+			// Check for free slots
+			if (!m_freeEntities.Empty())
+			{
+				EntityIndex newIndex = m_freeEntities.Pop();
+				m_highWaterMark = std::max(m_highWaterMark, size_t(newIndex) + 1);
+				
+				m_masks[newIndex].set(ENABLED_BIT).set(AWAKE_BIT);
+				m_awakePerChunk[newIndex / DORMANT_CHUNK_SIZE]++;
+				m_alive.Insert(newIndex);
+				
+				return CreateEntityId(newIndex, m_versions[newIndex]);
+			}
+
+			EntityIndex newIndex = EntityIndex(m_versions.size());
+			m_versions.push_back(0);
+			m_masks.push_back(ComponentMask().set(ENABLED_BIT).set(AWAKE_BIT));
+
+			if (m_awakePerChunk.size() * DORMANT_CHUNK_SIZE < m_versions.size())
+				m_awakePerChunk.push_back(0);
+			m_awakePerChunk.back()++;
+			m_alive.Insert(newIndex);
+			m_highWaterMark = m_versions.size();
+
+			return CreateEntityId(newIndex, 0);
+		}
+
+		// Creates 'count' entities at once, sizing the entity table a single time
+		std::vector<EntityID> NewEntities(size_t count)
+		{
+			Reserve(m_versions.size() + std::max(count, m_freeEntities.Size()) - m_freeEntities.Size());
+
+			NoteAllocation("World::NewEntities", count * sizeof(EntityID));
+			std::vector<EntityID> ids(count);
+			for (EntityID& id : ids)
+				id = NewEntity();
+
+			return ids;
+		}
+
+		// Creates 'count' copies of the entity, each with a copy of every component it owns.
+		// Trivially copyable components are copied with memcpy, others through their copy
+		// constructor, components that cannot be copied are left out. Clones start awake
+		std::vector<EntityID> Clone(EntityID id, size_t count = 1)
+		{
+			// Ensures you're not accessing an entity that has been deleted
+			if (!IsCurrent(id) || count == 0)
+				return {};
+
+			EntityIndex source = GetEntityIndex(id);
+			std::vector<EntityID> clones = NewEntities(count);
+
+			EntityIndex highest = 0;
+			for (EntityID clone : clones)
+				highest = std::max(highest, GetEntityIndex(clone));
+
+			ComponentMask mask = m_masks[source];
+			mask.set(AWAKE_BIT);
+
+			for (ComponentID componentId = 0; componentId < m_componentPools.size(); componentId++)
+			{
+				ComponentPool* pool = m_componentPools[componentId];
+				if (pool == nullptr || !pool->Contains(source))
+					continue;
+
+				const ComponentInfo& info = GetComponentInfo(componentId);
+				if (!info.m_triviallyCopyable && info.m_copy == nullptr)
+				{
+					mask.reset(componentId);
+					continue;
+				}
+
+				// Grow first, the source component may move
+				pool->EnsureCapacity(size_t(highest) + 1);
+				const void* src = pool->Get<std::byte>(source);
+
+				for (EntityID clone : clones)
+				{
+					void* dst = pool->Emplace(GetEntityIndex(clone));
+					if (info.m_copy)
+						info.m_copy(dst, src);
+					else
+						std::memcpy(dst, src, info.m_size);
+
+					// Copies start detached from the pool's storage
+					if (info.m_bind)
+						info.m_bind(dst, pool);
+					IndexInsert(componentId, GetEntityIndex(clone));
+				}
+			}
+
+			for (EntityID clone : clones)
+			{
+				m_masks[GetEntityIndex(clone)] = mask;
+				UpdateActivity(GetEntityIndex(clone));
+			}
+
+			return clones;
+		}
+
+		void DestroyEntity(EntityID id)
+		{
+			// Ensures you're not destroying an entity twice
+			if (!IsCurrent(id))
+				return;
+
+			m_structuralVersion++;
+
+			// Pairs that target the entity go first, then the indices drop it while its
+			// components, which relation indices read, are still in place
+			for (RelationIndex* relation : m_relations)
+				DropTarget(relation, GetEntityIndex(id));
+
+			for (FieldIndexBase* index : m_fieldIndices)
+				index->Erase(GetEntityIndex(id));
+
+			// Drop the entity from the membership list of every component it owns, disabled
+			// components are not in the mask so every pool has to be checked
+			for (ComponentPool* pool : m_componentPools)
+			{
+				if (pool)
+					pool->Erase(GetEntityIndex(id));
+			}
+
+			if (m_masks[GetEntityIndex(id)].test(AWAKE_BIT))
+				m_awakePerChunk[GetEntityIndex(id) / DORMANT_CHUNK_SIZE]--;
+			m_alive.Erase(GetEntityIndex(id));
+
+			// Bumping the version makes every outstanding copy of the ID stale
+			m_versions[GetEntityIndex(id)]++;
+			m_masks[GetEntityIndex(id)].reset();
+			m_freeEntities.Push(GetEntityIndex(id));
+
+			// Pull the high-water mark back past any trailing destroyed slots
+			while (m_highWaterMark > 0 && !m_alive.Contains(EntityIndex(m_highWaterMark - 1)))
+				m_highWaterMark--;
+		}
+		
+		template <typename T, typename... Args>
+		T*  Assign(EntityID id, Args&&... args) requires
+			std::is_constructible_v<T>
+			&& (std::is_constructible_v<T, Args...> || std::is_default_constructible_v<T>)
+		{
+			ComponentID componentId = GetId<T>();
+
+			// Ensures you're not accessing an entity that has been deleted
+			if (!IsCurrent(id))
+				return nullptr;
+
+			ComponentPool* pool = EnsurePool(componentId);
+			Wake(id);
+
+			// Constructing over an existing component does not change the entity's layout
+			if (!m_masks[GetEntityIndex(id)].test(componentId))
+				m_structuralVersion++;
+
+			// Indices forget the component being replaced
+			if (pool->Contains(GetEntityIndex(id)))
+				IndexErase(componentId, GetEntityIndex(id));
+
+			// Looks up the component in the pool and initializes it with placement new
+			if constexpr (std::is_constructible_v<T, Args...>) 
+			{
+				// The arguments may refer to a component of this pool, which growing the pool moves
+				T* comp = static_cast<T*>(pool->Emplace(GetEntityIndex(id), [&](void* slot) { new (slot) T(std::forward<Args>(args)...); }));
+				BindBuffer(pool, comp);
+				IndexPlaced(componentId, GetEntityIndex(id));
+				m_masks[GetEntityIndex(id)].set(componentId);
+				UpdateActivity(componentId, GetEntityIndex(id));
+				return comp;
+			}
+			else if constexpr (std::is_default_constructible_v<T>) 
+			{
+				T* comp = new (pool->Emplace(GetEntityIndex(id))) T();
+				BindBuffer(pool, comp);
+				IndexPlaced(componentId, GetEntityIndex(id));
+				m_masks[GetEntityIndex(id)].set(componentId);
+				UpdateActivity(componentId, GetEntityIndex(id));
+				return comp;
+			}
+			else
+				return nullptr; // Component type cannot be constructed
+
+		}
+
+		// Default constructs every listed component on the entity in one step.
+		// The entity is validated once and its mask is updated with a single write,
+		// which is what spawn code attaching many components at once wants
+		template <typename... T>
+		std::tuple<T*...> AddComponents(EntityID id) requires
+			(sizeof...(T) > 0) && (std::is_default_constructible_v<T> && ...)
+		{
+			// Ensures you're not accessing an entity that has been deleted
+			if (!IsCurrent(id))
+				return std::tuple<T*...>{};
+
+			EntityIndex index = GetEntityIndex(id);
+			m_structuralVersion++;
+			Wake(id);
+
+			ComponentMask added;
+			std::tuple<T*...> comps{ AddComponent<T>(index, added)... };
+
+			m_masks[index] |= added;
+			UpdateActivity(index);
+			return comps;
+		}
+
+		// Assigns a copy of 'value' to every entity in 'ids', skipping stale IDs.
+		// The pool is prepared once for the whole batch, returns the number of components assigned
+		template <typename T>
+		size_t AssignMany(std::span<const EntityID> ids, const T& value) requires std::is_copy_constructible_v<T>
+		{
+			// 'value' may live in this pool, which growing moves and assigning over destroys
+			const T copy(value);
+			return AssignMany<T>(ids, [&copy](size_t) -> const T& { return copy; });
+		}
+
+		// Assigns generator(i) to the i-th entity in 'ids', skipping stale IDs
+		template <typename T, typename Fn>
+		size_t AssignMany(std::span<const EntityID> ids, Fn&& generator) requires std::is_invocable_v<Fn, size_t>
+		{
+			ComponentID componentId = GetId<T>();
+			ComponentPool* pool = EnsurePool(componentId);
+
+			// Validate the whole batch up front and size the pool for its highest index
+			size_t count = 0;
+			size_t capacity = 0;
+			for (EntityID id : ids)
+			{
+				if (IsCurrent(id))
+				{
+					capacity = std::max(capacity, size_t(GetEntityIndex(id)) + 1);
+					count++;
+				}
+			}
+
+			if (count == 0)
+				return 0;
+
+			pool->EnsureCapacity(capacity);
+			pool->Owners().Reserve(pool->Size() + count);
+
+			for (size_t i = 0; i < ids.size(); i++)
+			{
+				EntityID id = ids[i];
+				if (!IsCurrent(id))
+					continue;
+
+				Wake(id);
+				if (pool->Contains(GetEntityIndex(id)))
+					IndexErase(componentId, GetEntityIndex(id));
+
+				// The generator may read the component being replaced, so it runs before that one is destroyed
+				T* comp = static_cast<T*>(pool->Emplace(GetEntityIndex(id), [&](void* slot) { new (slot) T(generator(i)); }));
+				BindBuffer(pool, comp);
+				IndexInsert(componentId, GetEntityIndex(id));
+				m_masks[GetEntityIndex(id)].set(componentId);
+				UpdateActivity(componentId, GetEntityIndex(id));
+			}
+
+			m_structuralVersion++;
+			return count;
+		}
+
+		template<typename T>
+		void Remove(EntityID id)
+		{
+			RemoveRaw(id, GetId<T>());
+		}
+
+		template <typename T>
+		[[nodiscard]] 
+		T* Get(EntityID id)
+		{
+			ComponentID componentId = GetId<T>();
+			if (!m_masks[GetEntityIndex(id)].test(componentId))
+				return nullptr;
+
+			if (componentId < m_componentPools.size() && m_componentPools[componentId])
+			{
+				// The caller may change an indexed field through the pointer
+				if (m_indexedComponents.test(componentId))
+					IndexDirty(componentId, GetEntityIndex(id));
+
+				return m_componentPools[componentId]->Get<T>(GetEntityIndex(id));
+			}
+
+			return nullptr;
+		}
+
+		template <typename T>
+		bool Has(EntityID id)
+		{
+			return !(Get<T>(id) == nullptr);
+		}
+
+		// Copies 'bytes' into the entity's component, the component is zeroed when 'bytes' is null.
+		// Works for trivially copyable components, including every one defined at runtime.
+		// Other components have no valid byte representation and are rejected
+		void* AssignRaw(EntityID id, ComponentID componentId, const void* bytes)
+		{
+			// Ensures you're not accessing an entity that has been deleted
+			if (!IsCurrent(id))
+				return nullptr;
+
+			const ComponentInfo& info = GetComponentInfo(componentId);
+			assert(info.m_triviallyCopyable && "AssignRaw needs a trivially copyable component");
+			if (!info.m_triviallyCopyable)
+				return nullptr;
+			ComponentPool* pool = EnsurePool(componentId);
+			Wake(id);
+
+			if (!m_masks[GetEntityIndex(id)].test(componentId))
+				m_structuralVersion++;
+
+			if (pool->Contains(GetEntityIndex(id)))
+				IndexErase(componentId, GetEntityIndex(id));
+
+			// 'bytes' may point into this pool, so they are copied before a growing pool releases its storage
+			void* comp = pool->Emplace(GetEntityIndex(id), [&](void* slot)
+			{
+				if (bytes)
+					std::memcpy(slot, bytes, info.m_size);
+				else
+					std::memset(slot, 0, info.m_size);
+			});
+
+			IndexPlaced(componentId, GetEntityIndex(id));
+			m_masks[GetEntityIndex(id)].set(componentId);
+			UpdateActivity(componentId, GetEntityIndex(id));
+			return comp;
+		}
+
+		[[nodiscard]]
+		void* GetRaw(EntityID id, ComponentID componentId)
+		{
+			// A stale id would hand out the component of the entity that reused its slot
+			if (!IsCurrent(id) || !m_masks[GetEntityIndex(id)].test(componentId))
+				return nullptr;
+
+			if (componentId < m_componentPools.size() && m_componentPools[componentId])
+			{
+				if (m_indexedComponents.test(componentId))
+					IndexDirty(componentId, GetEntityIndex(id));
+
+				return m_componentPools[componentId]->Get<std::byte>(GetEntityIndex(id));
+			}
+
+			return nullptr;
+		}
+
+		void RemoveRaw(EntityID id, ComponentID componentId)
+		{
+			// Ensures you're not accessing an entity that has been deleted
+			if (!IsCurrent(id))
+				return;
+
+			if (componentId >= m_componentPools.size() || m_componentPools[componentId] == nullptr
+				|| !m_componentPools[componentId]->Contains(GetEntityIndex(id)))
+				return;
+
+			Wake(id);
+			IndexErase(componentId, GetEntityIndex(id));
+			m_componentPools[componentId]->Erase(GetEntityIndex(id));
+			m_masks[GetEntityIndex(id)].reset(componentId);
+			m_structuralVersion++;
+		}
+
+		// Removes the component from every entity that has it, in time proportional to the pool.
+		// Unlike Remove this does not wake sleeping entities
+		template <typename T>
+		void Clear()
+		{
+			ClearRaw(GetId<T>());
+		}
+
+		void ClearRaw(ComponentID componentId)
+		{
+			if (componentId >= m_componentPools.size() || m_componentPools[componentId] == nullptr)
+				return;
+
+			ComponentPool* pool = m_componentPools[componentId];
+			std::span<const EntityIndex> owners = pool->Owners().Entities();
+
+			// Reset the owners' bits directly while the pool is small, otherwise sweep every
+			// mask with one AND, which is a straight vectorizable pass over the array
+			if (owners.size() * QUERY_PROBE_COST < m_highWaterMark)
+			{
+				for (EntityIndex index : owners)
+					m_masks[index].reset(componentId);
+			}
+			else
+			{
+				ComponentMask keep = ComponentMask().set(componentId).flip();
+				for (size_t index = 0; index < m_highWaterMark; index++)
+					m_masks[index] &= keep;
+			}
+
+			for (FieldIndexBase* index : m_fieldIndices)
+			{
+				if (index->GetComponentId() == componentId)
+					index->Clear();
+			}
+
+			pool->Clear();
+			m_structuralVersion++;
+		}
+
+		// Removes the component from every entity matched by the query.
+		// Like Clear this does not wake sleeping entities
+		template <typename T>
+		void RemoveAll(const DynamicQuery& query)
+		{
+			RemoveAllRaw(GetId<T>(), query);
+		}
+
+		void RemoveAllRaw(ComponentID componentId, const DynamicQuery& query);
+
+
+		// Disabled entities keep all their components but are skipped by every query. No component
+		// data moves, but every pool is checked and the entity's index swapped between the active
+		// part and the inactive tail of each pool it belongs to, so this costs O(component types)
+		void SetEnabled(EntityID id, bool enabled)
+		{
+			// Ensures you're not accessing an entity that has been deleted
+			if (!IsCurrent(id))
+				return;
+
+			m_masks[GetEntityIndex(id)].set(ENABLED_BIT, enabled);
+			UpdateActivity(GetEntityIndex(id));
+		}
+
+		bool IsEnabled(EntityID id) const
+		{
+			return IsCurrent(id) && m_masks[GetEntityIndex(id)].test(ENABLED_BIT);
+		}
+
+		// A disabled component keeps its data in the pool but is hidden from Get, Has and queries
+		// until it is enabled again. Flips the component's mask bit and swaps the entity's index
+		// into or out of the active part of the pool, no component data moves
+		template <typename T>
+		void SetEnabled(EntityID id, bool enabled)
+		{
+			// Ensures you're not accessing an entity that has been deleted
+			if (!IsCurrent(id))
+				return;
+
+			ComponentID componentId = GetId<T>();
+			if (componentId < m_componentPools.size() && m_componentPools[componentId]
+				&& m_componentPools[componentId]->Contains(GetEntityIndex(id)))
+			{
+				m_masks[GetEntityIndex(id)].set(componentId, enabled);
+				UpdateActivity(componentId, GetEntityIndex(id));
+			}
+		}
+
+		template <typename T>
+		bool IsEnabled(EntityID id) const
+		{
+			return IsCurrent(id) && m_masks[GetEntityIndex(id)].test(GetId<T>());
+		}
+
+		// Puts the entity to sleep. Sleeping entities are skipped by every query, and their pool
+		// slots are parked behind the awake ones so iteration never visits them.
+		// Assigning or removing a component wakes the entity again, as does Wake
+		void Sleep(EntityID id)
+		{
+			// Ensures you're not accessing an entity that has been deleted
+			if (!IsCurrent(id) || !m_masks[GetEntityIndex(id)].test(AWAKE_BIT))
+				return;
+
+			m_masks[GetEntityIndex(id)].reset(AWAKE_BIT);
+			m_awakePerChunk[GetEntityIndex(id) / DORMANT_CHUNK_SIZE]--;
+			UpdateActivity(GetEntityIndex(id));
+		}
+
+		void Wake(EntityID id)
+		{
+			// Ensures you're not accessing an entity that has been deleted
+			if (!IsCurrent(id) || m_masks[GetEntityIndex(id)].test(AWAKE_BIT))
+				return;
+
+			m_masks[GetEntityIndex(id)].set(AWAKE_BIT);
+			m_awakePerChunk[GetEntityIndex(id) / DORMANT_CHUNK_SIZE]++;
+			UpdateActivity(GetEntityIndex(id));
+		}
+
+		bool IsSleeping(EntityID id) const
+		{
+			return IsCurrent(id) && !m_masks[GetEntityIndex(id)].test(AWAKE_BIT);
+		}
+
+		// Returns the first entity index at or after 'index' whose chunk has an awake entity
+		EntityIndex SkipDormant(EntityIndex index) const
+		{
+			size_t chunk = index / DORMANT_CHUNK_SIZE;
+			if (chunk >= m_awakePerChunk.size() || m_awakePerChunk[chunk] != 0)
+				return index;
+
+			while (chunk < m_awakePerChunk.size() && m_awakePerChunk[chunk] == 0)
+				chunk++;
+
+			return EntityIndex(std::min(chunk * DORMANT_CHUNK_SIZE, m_highWaterMark));
+		}
+
+		// Indices of every alive entity, packed. Awake enabled entities come first, then sleeping or disabled ones
+		std::span<const EntityIndex> Alive() const
+		{
+			return m_alive.Entities();
+		}
+
+		size_t AliveCount() const
+		{
+			return m_alive.Size();
+		}
+
+		// Number of alive entities that are awake and enabled, that is visible to queries
+		size_t ActiveCount() const
+		{
+			return m_alive.ActiveCount();
+		}
+
+		EntityTable All() const
+		{
+			return EntityTable(this);
+		}
+
+		// Component masks of every entity slot, destroyed slots have an empty mask
+		std::span<const ComponentMask> Masks() const
+		{
+			return m_masks;
+		}
+
+		// Version of every entity slot, bumped each time the slot's entity is destroyed
+		std::span<const EntityVersion> Versions() const
+		{
+			return m_versions;
+		}
+
+		// One past the highest alive entity index, mask scans stop here
+		size_t HighWaterMark() const
+		{
+			return m_highWaterMark;
+		}
+
+		// ID of the entity currently living at 'index'
+		EntityID GetEntityId(EntityIndex index) const
+		{
+			return CreateEntityId(index, m_versions[index]);
+		}
+
+		// Whether the ID refers to the entity alive in its slot, rather than a destroyed one
+		// Whether the id names a live entity. Ids from outside, such as script handles, may hold
+		// any index, so ones past the entity table are rejected rather than read
+		bool IsCurrent(EntityID id) const
+		{
+			return GetEntityIndex(id) < m_versions.size() && m_versions[GetEntityIndex(id)] == GetEntityVersion(id);
+		}
+
+		// Returns the component's pool, or nullptr if no entity has ever owned the component
+		const ComponentPool* GetPool(ComponentID componentId) const
+		{
+			return componentId < m_componentPools.size() ? m_componentPools[componentId] : nullptr;
+		}
+
+		ComponentPool* GetPool(ComponentID componentId)
+		{
+			return componentId < m_componentPools.size() ? m_componentPools[componentId] : nullptr;
+		}
+
+		// Incremented by every change to which entities exist or which components they own.
+		// Pointers into pools and query results stay valid while this value is unchanged
+		unsigned long long StructuralVersion() const
+		{
+			return m_structuralVersion;
+		}
+
+		// Picks the candidate set a query over 'mask' should iterate.
+		// Returns the smallest of the participating pools and the alive list, or nullptr when
+		// scanning every entity's mask is cheaper than probing the set's awake entities
+		const EntitySet* PlanQuery(const ComponentMask& mask) const
+		{
+			static const EntitySet s_noMatches;
+
+			const EntitySet* smallest = &m_alive;
+			unsigned long long bits = ComponentBits(mask);
+			while (bits)
+			{
+				ComponentID componentId = std::countr_zero(bits);
+				bits &= bits - 1;
+
+				// No pool means no entity has ever owned this component
+				if (componentId >= m_componentPools.size() || m_componentPools[componentId] == nullptr)
+					return &s_noMatches;
+
+				const EntitySet& owners = m_componentPools[componentId]->Owners();
+				if (owners.ActiveCount() < smallest->ActiveCount())
+					smallest = &owners;
+			}
+
+			// Probing is random access into the entity table, so only drive from the set when it is clearly smaller
+			if (smallest->ActiveCount() * QUERY_PROBE_COST < m_highWaterMark)
+				return smallest;
+
+			return nullptr;
+		}
+
+	private:
+		// Keeps the entity in the active part of the component's pool exactly when queries can see
+		// the component, that is when the entity is enabled and awake and the component is enabled
+		void UpdateActivity(ComponentID componentId, EntityIndex index)
+		{
+			const ComponentMask& mask = m_masks[index];
+			if (mask.test(ENABLED_BIT) && mask.test(AWAKE_BIT) && mask.test(componentId))
+				m_componentPools[componentId]->Owners().Activate(index);
+			else
+				m_componentPools[componentId]->Owners().Deactivate(index);
+		}
+
+		// Updates the entity's place in every pool it belongs to and in the alive list
+		void UpdateActivity(EntityIndex index)
+		{
+			for (ComponentID componentId = 0; componentId < m_componentPools.size(); componentId++)
+			{
+				if (m_componentPools[componentId] && m_componentPools[componentId]->Contains(index))
+					UpdateActivity(componentId, index);
+			}
+
+			if (m_masks[index].test(ENABLED_BIT) && m_masks[index].test(AWAKE_BIT))
+				m_alive.Activate(index);
+			else
+				m_alive.Deactivate(index);
+		}
+
+		// Resizes the component pool vector if necessary and makes a pool for new components
+		ComponentPool* EnsurePool(ComponentID componentId)
+		{
+			if (componentId >= m_componentPools.size())
+				m_componentPools.resize(componentId + 1, nullptr);
+
+			if (m_componentPools[componentId] == nullptr)  // New component, make a new pool
+			{
+				NoteAllocation("World::EnsurePool", sizeof(ComponentPool));
+				m_componentPools[componentId] = new ComponentPool(GetComponentInfo(componentId));
+			}
+
+			return m_componentPools[componentId];
+		}
+
+		template <typename Relation>
+		RelationIndex* EnsureRelation()
+		{
+			ComponentID componentId = GetId<Pair<Relation, Wildcard>>();
+			if (RelationIndex* relation = FindRelation(componentId))
+				return relation;
+
+			RelationIndex* relation = new RelationIndex(componentId, EnsurePool(componentId), &s_relationTag<Relation>);
+			m_fieldIndices.push_back(relation);
+			m_relations.push_back(relation);
+			m_indexedComponents.set(componentId);
+			return relation;
+		}
+
+		RelationIndex* FindRelation(ComponentID componentId) const
+		{
+			for (RelationIndex* relation : m_relations)
+			{
+				if (relation->GetComponentId() == componentId)
+					return relation;
+			}
+			return nullptr;
+		}
+
+		// Swap-removes the target from the source's target list and the reverse index
+		void RemoveTarget(RelationIndex* relation, EntityIndex source, RelationTargets& targets, EntityID target)
+		{
+			EntityID* found = std::find(targets.begin(), targets.end(), target);
+			if (found == targets.end())
+				return;
+
+			*found = targets[targets.size() - 1];
+			targets.pop_back();
+			relation->RemoveEdge(source, GetEntityIndex(target));
+		}
+
+		// Removes every pair of the relation that targets a destroyed entity
+		void DropTarget(RelationIndex* relation, EntityIndex target)
+		{
+			ComponentID componentId = relation->GetComponentId();
+			ComponentPool* pool = m_componentPools[componentId];
+
+			for (EntityIndex source : relation->TakeSources(target))
+			{
+				RelationTargets& targets = *pool->Get<RelationTargets>(source);
+				EntityID* found = std::find(targets.begin(), targets.end(), GetEntityId(target));
+				if (found != targets.end())
+				{
+					*found = targets[targets.size() - 1];
+					targets.pop_back();
+				}
+
+				if (targets.empty())
+					RemoveRaw(GetEntityId(source), componentId);
+			}
+		}
+
+		FieldIndexBase* FindIndex(const void* field) const
+		{
+			for (FieldIndexBase* index : m_fieldIndices)
+			{
+				if (index->FieldTag() == field)
+					return index;
+			}
+			return nullptr;
+		}
+
+		// Keeps the component's field indices in step with its pool
+		void IndexInsert(ComponentID componentId, EntityIndex entity)
+		{
+			if (!m_indexedComponents.test(componentId))
+				return;
+
+			for (FieldIndexBase* index : m_fieldIndices)
+			{
+				if (index->GetComponentId() == componentId)
+					index->Insert(entity);
+			}
+		}
+
+		// Indexes a component that is handed back as a mutable pointer, so the entry is also
+		// rechecked on the next lookup in case the caller changes its fields
+		void IndexPlaced(ComponentID componentId, EntityIndex entity)
+		{
+			IndexInsert(componentId, entity);
+			if (m_indexedComponents.test(componentId))
+				IndexDirty(componentId, entity);
+		}
+
+		void IndexErase(ComponentID componentId, EntityIndex entity)
+		{
+			if (!m_indexedComponents.test(componentId))
+				return;
+
+			for (FieldIndexBase* index : m_fieldIndices)
+			{
+				if (index->GetComponentId() == componentId)
+					index->Erase(entity);
+			}
+		}
+
+		void IndexDirty(ComponentID componentId, EntityIndex entity)
+		{
+			for (FieldIndexBase* index : m_fieldIndices)
+			{
+				if (index->GetComponentId() == componentId)
+					index->MarkDirty(entity);
+			}
+		}
+
+		// Points a newly placed Buffer component at its pool's overflow arena
+		template <typename T>
+		void BindBuffer(ComponentPool* pool, T* comp)
+		{
+			if constexpr (IsBuffer<T>::value)
+				BufferOps<T>::Bind(comp, pool);
+		}
+
+		// Constructs a single component for AddComponents, deferring the mask update to the caller
+		template <typename T>
+		T* AddComponent(EntityIndex index, ComponentMask& added)
+		{
+			ComponentID componentId = GetId<T>();
+			ComponentPool* pool = EnsurePool(componentId);
+			if (pool->Contains(index))
+				IndexErase(componentId, index);
+
+			T* comp = new (pool->Emplace(index)) T();
+			BindBuffer(pool, comp);
+			IndexPlaced(componentId, index);
+			added.set(componentId);
+
+			return comp;
+		}
+
+	private:		
+		// The entity table is split into parallel arrays so mask scans only pull masks into cache
+		TrackedVector<EntityVersion>  m_versions{ TrackedAllocator<EntityVersion>("World::m_versions") };               // Version of each entity slot
+		TrackedVector<ComponentMask>  m_masks{ TrackedAllocator<ComponentMask>("World::m_masks") };                     // Component mask of each entity slot
+		FreeList                      m_freeEntities;    // List of all free entity indices
+		size_t                        m_highWaterMark{ 0 };
+		TrackedVector<ComponentPool*> m_componentPools{ TrackedAllocator<ComponentPool*>("World::m_componentPools") };  // List of component pools
+		unsigned long long            m_structuralVersion{ 0 };
+		TrackedVector<unsigned int>   m_awakePerChunk{ TrackedAllocator<unsigned int>("World::m_awakePerChunk") };      // Number of awake entities in each DORMANT_CHUNK_SIZE chunk
+		EntitySet                     m_alive;           // Alive entity indices, sleeping or disabled ones in the inactive tail
+		unsigned long long            m_serial;          // Unique per world, keys the threads' arena caches
+		std::mutex                    m_arenaMutex;
+		std::deque<FrameArena>        m_arenas;          // One scratch arena per thread that asked for one
+		std::vector<std::thread::id>  m_arenaThreads;    // Owning thread of each arena
+		TrackedVector<FieldIndexBase*> m_fieldIndices{ TrackedAllocator<FieldIndexBase*>("World::m_fieldIndices") };  // Secondary indices made by CreateIndex
+		ComponentMask                 m_indexedComponents;  // Components with at least one field index
+		TrackedVector<RelationIndex*> m_relations{ TrackedAllocator<RelationIndex*>("World::m_relations") };  // Reverse indices of relations, owned by m_fieldIndices
+	};
+
+	template <typename... ComponentTypes>
+	ComponentMask MaskOf()
+	{
+		ComponentMask mask;
+		if constexpr (sizeof...(ComponentTypes) > 0)
+		{
+			// Unpack the template parameters into an initializer list
+			ComponentID componentIds[] = { GetId<ComponentTypes>() ... };
+
+			for (ComponentID componentId : componentIds)
+			{
+				mask.set(componentId);
+			}
+		}
+		return mask;
+	}
+
+	// Iterates every entity that owns all of a runtime list of components.
+	// RosterView builds the same query from its template parameters
+	class DynamicQuery
+	{
+	public:
+		DynamicQuery(World& roster, ComponentMask mask)
+			:
+			m_rosterPtr(&roster),
+			m_componentMask(mask)
+		{
+			m_componentMask.set(ENABLED_BIT).set(AWAKE_BIT);
+		}
+
+		DynamicQuery(World& roster, std::span<const ComponentID> componentIds)
+			:
+			DynamicQuery(roster, ComponentMask())
+		{
+			for (ComponentID componentId : componentIds)
+			{
+				m_componentMask.set(componentId);
+			}
+		}
+
+		DynamicQuery(World& roster, std::initializer_list<ComponentID> componentIds)
+			:
+			DynamicQuery(roster, std::span<const ComponentID>(componentIds.begin(), componentIds.size()))
+		{
+		}
+
+		EntityID operator*() const
+		{
+			return m_rosterPtr->GetEntityId(Current());
+		}
+
+		bool operator==(const DynamicQuery& other) const
+		{
+			if (AtEnd() || other.AtEnd())
+				return AtEnd() == other.AtEnd();
+			return m_index == other.m_index;
+		}
+
+		bool operator!=(const DynamicQuery& other) const
+		{
+			return !(*this == other);
+		}
+
+		DynamicQuery& operator++()
+		{
+			// Keep going next until valid mask is found
+			do
+			{
+				Step();
+			} while (!AtEnd() && !ValidIndex());
+
+			return *this;
+		}
+
+		// The current entity and the ones already visited may lose components, be destroyed, put to
+		// sleep or disabled during the loop. Pool-driven queries walk the pool's set from the back,
+		// so those changes only swap visited entries around. Changing entities the loop has not
+		// reached yet may make it skip them or visit one twice
+		DynamicQuery begin() const
+		{
+			// Plan against the live pool sizes
+			const EntitySet* driver = m_rosterPtr->PlanQuery(m_componentMask);
+
+			DynamicQuery first = Prepared();
+			first.m_driver = driver;
+			first.m_index = driver ? EntityIndex(driver->ActiveCount()) : first.SkipChunks(0);
+			if (!first.AtEnd() && !first.ValidIndex())
+				++first;
+
+			return first;
+		}
+
+		DynamicQuery end() const
+		{
+			return DynamicQuery(*m_rosterPtr, EntityIndex(m_rosterPtr->All().size()), m_componentMask, nullptr);
+		}
+
+		const ComponentMask& Mask() const
+		{
+			return m_componentMask;
+		}
+
+		// Copy of the query that only matches entities whose field lies in [low, high], e.g.
+		// Where<&Transform::m_x>(0.0f, 10.0f). Owning the field's component becomes part of the
+		// query. With a Summary index on the field, mask scans skip chunks outside the range
+		template <auto Field>
+		DynamicQuery Where(const typename MemberPointerTraits<decltype(Field)>::Value& low, const typename MemberPointerTraits<decltype(Field)>::Value& high) const
+		{
+			DynamicQuery query = *this;
+			query.AddClause<Field>(low, high);
+			return query;
+		}
+
+		bool HasClauses() const
+		{
+			return m_clauseCount != 0;
+		}
+
+		// Whether the entity at 'index' matches the query, Where clauses included
+		bool Matches(EntityIndex index) const
+		{
+			// Destroyed slots have an empty mask, and every query requires the entity state bits
+			if (m_componentMask != (m_componentMask & m_rosterPtr->Masks()[index]))
+				return false;
+
+			for (size_t i = 0; i < m_clauseCount; i++)
+			{
+				if (!m_clauses[i].m_matches(*m_rosterPtr, index, m_clauses[i]))
+					return false;
+			}
+			return true;
+		}
+
+		// Calls fn(id) for the matches that fall in this frame's slice, touching 1/slices of the
+		// candidates. Mask scans split matches into 'slices' buckets by entity index, so an entity
+		// stays in the same bucket from frame to frame and is visited once every 'slices' frames.
+		// Queries driven from a pool cut the pool's active owners into 'slices' contiguous ranges
+		// instead. Those buckets only hold still while the pool does: adding or removing the
+		// component, or sleeping or disabling owners, reorders the pool and can move an entity
+		// to another bucket, so within a cycle it may be skipped or visited twice
+		template <typename Fn>
+		void EachSliced(unsigned long long frame, size_t slices, Fn&& fn) const
+		{
+			assert(slices > 0 && "EachSliced needs at least one slice");
+			size_t bucket = size_t(frame % slices);
+
+			const EntitySet* driver = m_rosterPtr->PlanQuery(m_componentMask);
+			const DynamicQuery pass = Prepared();
+			if (driver)
+			{
+				// Back to front through the bucket's range, like iteration, so fn may remove the entities it is handed
+				size_t count = driver->ActiveCount();
+				size_t first = count * bucket / slices;
+				for (size_t left = count * (bucket + 1) / slices; left > first; left = std::min(left - 1, driver->ActiveCount()))
+				{
+					EntityIndex index = driver->Entities()[left - 1];
+					if (pass.Matches(index))
+						fn(m_rosterPtr->GetEntityId(index));
+				}
+				return;
+			}
+
+			size_t index = bucket;
+			while (index < m_rosterPtr->HighWaterMark())
+			{
+				// Skip dormant chunks, then realign to the bucket
+				size_t next = pass.SkipChunks(EntityIndex(index));
+				if (next != index)
+				{
+					index = next + (bucket + slices - next % slices) % slices;
+					continue;
+				}
+
+				if (pass.Matches(EntityIndex(index)))
+					fn(m_rosterPtr->GetEntityId(EntityIndex(index)));
+
+				index += slices;
+			}
+		}
+
+		// Number of matches. Queries over at most one component are answered from the set sizes
+		size_t Count() const
+		{
+			if (HasClauses())
+				return ReduceIndices(size_t(0), [](EntityIndex) { return size_t(1); }, std::plus<>());
+
+			unsigned long long bits = ComponentBits(m_componentMask);
+			if (bits == 0)
+				return m_rosterPtr->ActiveCount();
+
+			if (std::has_single_bit(bits))
+			{
+				const ComponentPool* pool = m_rosterPtr->GetPool(std::countr_zero(bits));
+				return pool ? pool->Owners().ActiveCount() : 0;
+			}
+
+			return ReduceIndices(size_t(0), [](EntityIndex) { return size_t(1); }, std::plus<>());
+		}
+
+		// Folds map(index) of every match into a value with combine, which must be associative.
+		// The candidates are cut into blocks of REDUCE_BLOCK_SIZE that each start from 'init', so
+		// 'init' must be the identity of combine. Enough blocks are spread over worker threads,
+		// map must then be safe to call concurrently. Block results are always combined in
+		// block order, so the result does not depend on the thread count or scheduling.
+		// Worker threads are started afresh by every call, there is no pool to keep them around
+		template <typename Value, typename Map, typename Combine>
+		Value ReduceIndices(Value init, Map&& map, Combine&& combine) const
+		{
+			const EntitySet* driver = m_rosterPtr->PlanQuery(m_componentMask);
+			const DynamicQuery pass = Prepared();
+
+			size_t extent = driver ? driver->ActiveCount() : m_rosterPtr->HighWaterMark();
+			size_t blockCount = (extent + REDUCE_BLOCK_SIZE - 1) / REDUCE_BLOCK_SIZE;
+
+			auto reduceBlock = [&](size_t block)
+			{
+				Value value = init;
+				size_t last = std::min((block + 1) * REDUCE_BLOCK_SIZE, extent);
+
+				if (driver == nullptr && !HasClauses())
+				{
+					// Without clauses a match is a plain word compare, so each awake chunk is first
+					// tested in a branch-free pass over the contiguous masks, which compilers vectorize
+					// on targets with 64 bit vector compares (SSE4.1 and later), then the hits are folded
+					const ComponentMask* masks = m_rosterPtr->Masks().data();
+					unsigned long long required = m_componentMask.to_ullong();
+					unsigned char hits[DORMANT_CHUNK_SIZE];
+
+					for (size_t chunk = pass.SkipChunks(EntityIndex(block * REDUCE_BLOCK_SIZE)); chunk < last;)
+					{
+						size_t chunkEnd = std::min((chunk / DORMANT_CHUNK_SIZE + 1) * DORMANT_CHUNK_SIZE, last);
+						size_t count = chunkEnd - chunk;
+
+						for (size_t i = 0; i < count; i++)
+							hits[i] = (masks[chunk + i].to_ullong() & required) == required;
+
+						for (size_t i = 0; i < count; i++)
+						{
+							if (hits[i])
+								value = combine(value, map(EntityIndex(chunk + i)));
+						}
+
+						chunk = pass.SkipChunks(EntityIndex(chunkEnd));
+					}
+					return value;
+				}
+
+				for (size_t i = block * REDUCE_BLOCK_SIZE; i < last; i++)
+				{
+					// Mask scans skip whole chunks of sleeping entities
+					if (driver == nullptr && i % DORMANT_CHUNK_SIZE == 0)
+					{
+						i = pass.SkipChunks(EntityIndex(i));
+						if (i >= last)
+							break;
+					}
+
+					EntityIndex index = driver ? driver->Entities()[i] : EntityIndex(i);
+					if (pass.Matches(index))
+						value = combine(value, map(index));
+				}
+				return value;
+			};
+
+			size_t workerCount = std::min<size_t>(std::thread::hardware_concurrency(), blockCount);
+			if (blockCount < REDUCE_PARALLEL_BLOCKS || workerCount < 2)
+			{
+				Value result = init;
+				for (size_t block = 0; block < blockCount; block++)
+					result = combine(result, reduceBlock(block));
+				return result;
+			}
+
+			// Wrapped so a bool result does not end up in a packed vector<bool>
+			struct Partial
+			{
+				Value m_value;
+			};
+			NoteAllocation("DynamicQuery::ReduceIndices workers", blockCount * sizeof(Partial) + workerCount * sizeof(std::thread));
+			std::vector<Partial> partials(blockCount, Partial{ init });
+
+			std::atomic<size_t> nextBlock{ 0 };
+			auto work = [&]()
+			{
+				for (size_t block = nextBlock++; block < blockCount; block = nextBlock++)
+					partials[block].m_value = reduceBlock(block);
+			};
+
+			std::vector<std::thread> workers;
+			for (size_t worker = 1; worker < workerCount; worker++)
+				workers.emplace_back(work);
+			work();
+			for (std::thread& worker : workers)
+				worker.join();
+
+			Value result = init;
+			for (const Partial& partial : partials)
+				result = combine(result, partial.m_value);
+			return result;
+		}
+
+	private:
+		DynamicQuery(World& roster, EntityIndex index, ComponentMask mask, const EntitySet* driver)
+			: 
+			DynamicQuery(roster, mask)
+		{
+			m_index = index;
+			m_driver = driver;
+		}
+
+		// Entity index the iterator currently points at
+		EntityIndex Current() const
+		{
+			return m_driver ? m_driver->Entities()[m_index - 1] : m_index;
+		}
+
+		bool AtEnd() const
+		{
+			return m_driver ? m_index == 0 : m_index >= Extent();
+		}
+
+		void Step()
+		{
+			// Pool-driven iteration counts the entries left, removals shrink the set under it
+			if (m_driver)
+			{
+				m_index = EntityIndex(std::min<size_t>(m_index - 1, m_driver->ActiveCount()));
+				return;
+			}
+
+			m_index++;
+
+			// Mask scans skip whole chunks of sleeping entities, and chunks the Where clauses rule out
+			if (m_driver == nullptr && m_index % DORMANT_CHUNK_SIZE == 0)
+				m_index = SkipChunks(m_index);
+		}
+
+		// Number of candidates in the set being iterated
+		size_t Extent() const
+		{
+			return m_driver ? m_driver->ActiveCount() : m_rosterPtr->HighWaterMark();
+		}
+
+		bool ValidIndex() const
+		{
+			return Matches(Current());
+		}
+
+		// Moves a mask scan forward past dormant chunks and chunks that the Where summaries rule out
+		EntityIndex SkipChunks(EntityIndex index) const
+		{
+			while (true)
+			{
+				index = m_rosterPtr->SkipDormant(index);
+				if (index >= m_rosterPtr->HighWaterMark())
+					return EntityIndex(m_rosterPtr->HighWaterMark());
+
+				if (ChunkMayMatch(index / SUMMARY_CHUNK_SIZE))
+					return index;
+
+				index = EntityIndex((index / SUMMARY_CHUNK_SIZE + 1) * SUMMARY_CHUNK_SIZE);
+			}
+		}
+
+		bool ChunkMayMatch(size_t chunk) const
+		{
+			for (size_t i = 0; i < m_clauseCount; i++)
+			{
+				const WhereClause& clause = m_clauses[i];
+				if (clause.m_summary && !clause.m_summary->ChunkMayMatch(chunk, clause.m_low, clause.m_high))
+					return false;
+			}
+			return true;
+		}
+
+		// Copy of the query for one pass. Indices can be dropped while a query is kept around, so
+		// summaries are only looked up here, and brought up to date since they are recomputed lazily
+		DynamicQuery Prepared() const
+		{
+			DynamicQuery pass = *this;
+			for (size_t i = 0; i < pass.m_clauseCount; i++)
+			{
+				WhereClause& clause = pass.m_clauses[i];
+				clause.m_summary = clause.m_findSummary(*m_rosterPtr);
+				if (clause.m_summary)
+					clause.m_summary->Refresh();
+			}
+			return pass;
+		}
+
+	protected:
+		static constexpr size_t MAX_WHERE_CLAUSES = 4;
+
+		// Range filter on a numeric field, bounds are stored as raw bytes of the field's type
+		struct WhereClause
+		{
+			ComponentID     m_componentId{ 0 };
+			FieldIndexBase* m_summary{ nullptr };  // Field's index during a pass if it has one, used to skip chunks
+			FieldIndexBase* (*m_findSummary)(const World& roster){ nullptr };
+			bool (*m_matches)(World& roster, EntityIndex index, const WhereClause& clause){ nullptr };
+			alignas(8) std::byte m_low[8]{};
+			alignas(8) std::byte m_high[8]{};
+		};
+
+		template <auto Field>
+		void AddClause(const typename MemberPointerTraits<decltype(Field)>::Value& low, const typename MemberPointerTraits<decltype(Field)>::Value& high)
+		{
+			using Component = typename MemberPointerTraits<decltype(Field)>::Class;
+			using Value     = typename MemberPointerTraits<decltype(Field)>::Value;
+			static_assert(std::is_arithmetic_v<Value> && sizeof(Value) <= 8, "Where clauses filter numeric fields");
+			assert(m_clauseCount < MAX_WHERE_CLAUSES && "Too many Where clauses on one query");
+
+			WhereClause& clause = m_clauses[m_clauseCount++];
+			clause.m_componentId = GetId<Component>();
+			clause.m_findSummary = [](const World& roster) { return roster.GetIndex<Field, IndexKind::Summary>(); };
+			std::memcpy(clause.m_low, &low, sizeof(Value));
+			std::memcpy(clause.m_high, &high, sizeof(Value));
+			clause.m_matches = [](World& roster, EntityIndex index, const WhereClause& clause)
+			{
+				Value value = roster.GetPool(clause.m_componentId)->Get<Component>(index)->*Field;
+
+				Value low, high;
+				std::memcpy(&low, clause.m_low, sizeof(Value));
+				std::memcpy(&high, clause.m_high, sizeof(Value));
+				return !(value < low) && !(high < value);
+			};
+
+			m_componentMask.set(clause.m_componentId);
+		}
+
+	protected:
 		EntityIndex   m_index{ 0 };
 		World*       m_rosterPtr{ nullptr };
 		ComponentMask m_componentMask;
-		bool          m_all{ false };
+		const EntitySet* m_driver{ nullptr };  // Pool membership driving iteration, nullptr for a mask scan
+		WhereClause   m_clauses[MAX_WHERE_CLAUSES];
+		size_t        m_clauseCount{ 0 };
+	};
+
+	inline void World::RemoveAllRaw(ComponentID componentId, const DynamicQuery& query)
+	{
+		if (componentId >= m_componentPools.size() || m_componentPools[componentId] == nullptr)
+			return;
+
+		// Gather first, erasing from a pool would reorder the set the query may be driving from
+		TrackedVector<EntityIndex> matches{ TrackedAllocator<EntityIndex>("World::RemoveAllRaw") };
+		for (EntityID id : query)
+			matches.push_back(GetEntityIndex(id));
+
+		ComponentPool* pool = m_componentPools[componentId];
+		for (EntityIndex index : matches)
+		{
+			IndexErase(componentId, index);
+			pool->Erase(index);
+			m_masks[index].reset(componentId);
+		}
+
+		m_structuralVersion++;
+	}
+
+	template <typename... ComponentTypes>
+	class RosterView : public DynamicQuery
+	{
+		template <typename T>
+		using PoolOf = ComponentPool*;
+
+	public:
+		RosterView(World& roster)
+			:
+			DynamicQuery(roster, MaskOf<ComponentTypes...>())
+		{
+		}
+
+		// Time-sliced iteration, calls fn(id, components...) for this frame's slice of the matches
+		template <typename Fn>
+		void EachSliced(unsigned long long frame, size_t slices, Fn&& fn) const
+		{
+			World& roster = *m_rosterPtr;
+			DynamicQuery::EachSliced(frame, slices, [&](EntityID id)
+			{
+				fn(id, *roster.Get<ComponentTypes>(id)...);
+			});
+		}
+
+		// Copy of the view restricted to entities whose field lies in [low, high], see DynamicQuery::Where
+		template <auto Field>
+		RosterView Where(const typename MemberPointerTraits<decltype(Field)>::Value& low, const typename MemberPointerTraits<decltype(Field)>::Value& high) const
+		{
+			RosterView view = *this;
+			view.template AddClause<Field>(low, high);
+			return view;
+		}
+
+		// Folds map(components...) of every match with combine, see DynamicQuery::ReduceIndices.
+		// The components are read in place without marking field indices, so map must not change indexed fields
+		template <typename Value, typename Map, typename Combine>
+		Value Reduce(Value init, Map&& map, Combine&& combine) const
+		{
+			// Resolve the pools once, so blocks only index straight into their storage
+			std::tuple<PoolOf<ComponentTypes>...> pools{ m_rosterPtr->GetPool(GetId<ComponentTypes>())... };
+			if (std::apply([](PoolOf<ComponentTypes>... pool) { return ((pool == nullptr) || ...); }, pools))
+				return init;
+
+			return ReduceIndices(std::move(init), [&](EntityIndex index)
+			{
+				return std::apply([&](PoolOf<ComponentTypes>... pool) { return map(*pool->template Get<ComponentTypes>(index)...); }, pools);
+			}, combine);
+		}
+
+		// Calls fn(id, components..., target) for every match whose entity field, e.g. &Follow::m_target,
+		// names a live entity owning Target. Matches are visited in batches sorted by target, so
+		// targets are read close to in memory order instead of one random Get per match.
+		// fn may destroy sources or targets and remove their components, later pairs that lost
+		// either side are skipped. A source whose field fn changes keeps its old target until the next Join
+		template <auto Field, typename Target, typename Fn>
+		void Join(Fn&& fn) const requires std::is_same_v<typename MemberPointerTraits<decltype(Field)>::Value, EntityID>
+		{
+			using Source = typename MemberPointerTraits<decltype(Field)>::Class;
+			static_assert((std::is_same_v<Source, ComponentTypes> || ...), "The joined field must belong to a component of the view");
+
+			World& roster = *m_rosterPtr;
+			ComponentPool*       sources = roster.GetPool(GetId<Source>());
+			const ComponentPool* targets = roster.GetPool(GetId<Target>());
+			if (sources == nullptr || targets == nullptr)
+				return;
+
+			// Target first, so sorting the pairs orders the batch by target index
+			std::array<std::pair<EntityID, EntityID>, JOIN_BATCH_SIZE> batch;
+			size_t count = 0;
+
+			auto visit = [&]()
+			{
+				std::sort(batch.begin(), batch.begin() + count);
+				for (size_t i = 0; i < count; i++)
+				{
+					if (i + JOIN_PREFETCH_DISTANCE < count)
+						Prefetch(targets->Data() + GetEntityIndex(batch[i + JOIN_PREFETCH_DISTANCE].first) * targets->ElementSize());
+
+					// Earlier calls may have destroyed either side or removed its components
+					EntityID id = batch[i].second;
+					EntityID target = batch[i].first;
+					if (!roster.IsCurrent(id) || !roster.IsCurrent(target))
+						continue;
+
+					// The batch's sources were just read, so they are still in cache
+					std::tuple<ComponentTypes*...> components{ roster.Get<ComponentTypes>(id)... };
+					Target* targetComponent = roster.Get<Target>(target);
+					if (targetComponent == nullptr || ((std::get<ComponentTypes*>(components) == nullptr) || ...))
+						continue;
+
+					fn(id, *std::get<ComponentTypes*>(components)..., *targetComponent);
+				}
+				count = 0;
+			};
+
+			std::span<const ComponentMask> masks = roster.Masks();
+			for (EntityID id : *this)
+			{
+				EntityID target = sources->template Get<Source>(GetEntityIndex(id))->*Field;
+				if (!IsEntityValid(target) || GetEntityIndex(target) >= masks.size() || !roster.IsCurrent(target) || !masks[GetEntityIndex(target)].test(GetId<Target>()))
+					continue;
+
+				batch[count++] = { target, id };
+				if (count == JOIN_BATCH_SIZE)
+					visit();
+			}
+			visit();
+		}
+
+		// Sum of a component field over every match, e.g. Sum<&Health::m_value>(). The sum is
+		// accumulated in and returned as Result, a widened type by default (see SumOf)
+		template <auto Field, typename Result = typename SumOf<typename MemberPointerTraits<decltype(Field)>::Value>::Type>
+		Result Sum() const
+		{
+			using Traits = MemberPointerTraits<decltype(Field)>;
+
+			return Reduce(Result{}, [](ComponentTypes&... components) -> Result
+			{
+				return Result(std::get<typename Traits::Class&>(std::forward_as_tuple(components...)).*Field);
+			}, [](const Result& a, const Result& b) -> Result { return a + b; });
+		}
+
+		// Smallest and largest value of a component field over every match.
+		// Without matches the result is { max(), lowest() } of the field type
+		template <auto Field>
+		auto MinMax() const
+		{
+			using Traits = MemberPointerTraits<decltype(Field)>;
+			using Value  = typename Traits::Value;
+			using Range  = std::pair<Value, Value>;
+
+			return Reduce(Range{ std::numeric_limits<Value>::max(), std::numeric_limits<Value>::lowest() }, [](ComponentTypes&... components) -> Range
+			{
+				const Value& value = std::get<typename Traits::Class&>(std::forward_as_tuple(components...)).*Field;
+				return { value, value };
+			}, [](const Range& a, const Range& b) -> Range
+			{
+				return { std::min(a.first, b.first), std::max(a.second, b.second) };
+			});
+		}
+	};
+
+	// Hierarchical timing wheel of per-entity timers. Each level has TIMER_WHEEL_SLOTS slots and
+	// covers TIMER_WHEEL_SLOTS times the range of the level below, timers cascade down a level
+	// as their deadline approaches. Advancing costs O(1) per tick plus the timers that expire
+	class TimerWheel
+	{
+	public:
+		static constexpr size_t             TIMER_WHEEL_LEVELS = 4;
+		static constexpr size_t             TIMER_WHEEL_BITS   = 6;
+		static constexpr size_t             TIMER_WHEEL_SLOTS  = size_t(1) << TIMER_WHEEL_BITS;
+		static constexpr unsigned long long TIMER_WHEEL_RANGE  = 1ull << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS);
+
+		TimerWheel()
+		{
+			for (unsigned int& head : m_slots)
+				head = NIL;
+		}
+
+		// Fires the entity's timer 'delay' ticks from now, replacing any timer it already has
+		void Schedule(EntityID id, unsigned long long delay)
+		{
+			Cancel(GetEntityIndex(id));
+
+			unsigned int node;
+			if (!m_freeTimers.empty())
+			{
+				node = m_freeTimers.back();
+				m_freeTimers.pop_back();
+			}
+			else
+			{
+				node = (unsigned int)m_timers.size();
+				m_timers.emplace_back();
+			}
+
+			m_timers[node].m_id = id;
+			m_timers[node].m_deadline = m_now + std::max(delay, 1ull);
+
+			if (GetEntityIndex(id) >= m_entityTimers.size())
+				m_entityTimers.resize(GetEntityIndex(id) + 1, NIL);
+			m_entityTimers[GetEntityIndex(id)] = node;
+
+			Place(node);
+			m_count++;
+		}
+
+		void Cancel(EntityID id)
+		{
+			if (IsScheduled(id))
+				Cancel(GetEntityIndex(id));
+		}
+
+		bool IsScheduled(EntityID id) const
+		{
+			EntityIndex index = GetEntityIndex(id);
+			return index < m_entityTimers.size() && m_entityTimers[index] != NIL && m_timers[m_entityTimers[index]].m_id == id;
+		}
+
+		// Moves time forward and calls fn(id) for every timer that expires, in deadline order
+		template <typename Fn>
+		void Advance(unsigned long long ticks, Fn&& fn)
+		{
+			for (unsigned long long tick = 0; tick < ticks; tick++)
+			{
+				if (m_count == 0)
+				{
+					m_now += ticks - tick;
+					return;
+				}
+
+				m_now++;
+
+				// Bring the timers of every level that wrapped around down towards level 0
+				for (size_t level = 1; level < TIMER_WHEEL_LEVELS; level++)
+				{
+					if ((m_now & ((1ull << (TIMER_WHEEL_BITS * level)) - 1)) != 0)
+						break;
+
+					Cascade(SlotOf(m_now, level));
+				}
+
+				unsigned int& head = m_slots[SlotOf(m_now, 0)];
+				while (head != NIL)
+				{
+					unsigned int node = head;
+					EntityID id = m_timers[node].m_id;
+
+					Cancel(GetEntityIndex(id));
+					fn(id);
+				}
+			}
+		}
+
+		// Moves time forward and assigns Tag to every entity whose timer expired.
+		// Destroyed entities are ignored by Assign, and sleeping ones wake up
+		template <typename Tag>
+		void Advance(World& world, unsigned long long ticks)
+		{
+			Advance(ticks, [&world](EntityID id)
+			{
+				world.Assign<Tag>(id);
+			});
+		}
+
+		unsigned long long Now() const
+		{
+			return m_now;
+		}
+
+		size_t Size() const
+		{
+			return m_count;
+		}
+
+	private:
+		static constexpr unsigned int NIL = (unsigned int)-1;
+
+		struct Timer
+		{
+			EntityID           m_id{ INVALID_ENTITY };
+			unsigned long long m_deadline{ 0 };
+			unsigned int       m_prev{ NIL };
+			unsigned int       m_next{ NIL };
+			size_t             m_slot{ 0 };  // Slot list the timer is linked into, level * TIMER_WHEEL_SLOTS + slot
+		};
+
+		static size_t SlotOf(unsigned long long tick, size_t level)
+		{
+			return level * TIMER_WHEEL_SLOTS + (size_t(tick >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1));
+		}
+
+		// Links the timer into the slot of the lowest level whose range covers its deadline
+		void Place(unsigned int node)
+		{
+			Timer& timer = m_timers[node];
+			unsigned long long deadline = std::min(timer.m_deadline, m_now + TIMER_WHEEL_RANGE - 1);
+			unsigned long long delta    = deadline - m_now;
+
+			size_t level = 0;
+			while (level + 1 < TIMER_WHEEL_LEVELS && delta >= (1ull << (TIMER_WHEEL_BITS * (level + 1))))
+				level++;
+
+			size_t slot = SlotOf(deadline, level);
+			unsigned int& head = m_slots[slot];
+			timer.m_prev = NIL;
+			timer.m_next = head;
+			timer.m_slot = slot;
+			if (head != NIL)
+				m_timers[head].m_prev = node;
+			head = node;
+		}
+
+		void Unlink(unsigned int node)
+		{
+			Timer& timer = m_timers[node];
+			if (timer.m_prev != NIL)
+				m_timers[timer.m_prev].m_next = timer.m_next;
+			else
+				m_slots[timer.m_slot] = timer.m_next;
+
+			if (timer.m_next != NIL)
+				m_timers[timer.m_next].m_prev = timer.m_prev;
+		}
+
+		void Cancel(EntityIndex index)
+		{
+			if (index >= m_entityTimers.size() || m_entityTimers[index] == NIL)
+				return;
+
+			unsigned int node = m_entityTimers[index];
+			Unlink(node);
+			m_entityTimers[index] = NIL;
+			m_freeTimers.push_back(node);
+			m_count--;
+		}
+
+		void Cascade(size_t slot)
+		{
+			unsigned int node = m_slots[slot];
+			m_slots[slot] = NIL;
+
+			while (node != NIL)
+			{
+				unsigned int next = m_timers[node].m_next;
+				Place(node);
+				node = next;
+			}
+		}
+
+	private:
+		unsigned long long        m_now{ 0 };
+		size_t                    m_count{ 0 };
+		TrackedVector<Timer>        m_timers{ TrackedAllocator<Timer>("TimerWheel::m_timers") };                    // Timer nodes, linked into the slots by index
+		TrackedVector<unsigned int> m_freeTimers{ TrackedAllocator<unsigned int>("TimerWheel::m_freeTimers") };     // Free timer nodes
+		TrackedVector<unsigned int> m_entityTimers{ TrackedAllocator<unsigned int>("TimerWheel::m_entityTimers") }; // Entity index -> timer node (or NIL)
+		unsigned int              m_slots[TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS];  // Head timer node of each slot
 	};
 }
@@ -0,0 +1,376 @@
+#pragma once
+#include "ECS.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+
+/*
+* Exports query results as Apache Arrow record batches through the Arrow C data and
+* C stream interfaces, so no Arrow library is needed to build against.
+* Each batch is a struct array with an "entity" column (uint64) followed by one
+* fixed-size-binary column per trivially copyable component in the query.
+* When the query matches most of the entity table, component columns point straight into
+* the pools with a validity bitmap marking non-matching rows. Sparse queries gather their
+* matches into owned buffers instead. Buffers that reference pools stay valid until the
+* world's next structural change, and the stream refuses to continue after one.
+*/
+
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+struct ArrowSchema
+{
+	const char* format;
+	const char* name;
+	const char* metadata;
+	int64_t flags;
+	int64_t n_children;
+	struct ArrowSchema** children;
+	struct ArrowSchema* dictionary;
+
+	void (*release)(struct ArrowSchema*);
+	void* private_data;
+};
+
+struct ArrowArray
+{
+	int64_t length;
+	int64_t null_count;
+	int64_t offset;
+	int64_t n_buffers;
+	int64_t n_children;
+	const void** buffers;
+	struct ArrowArray** children;
+	struct ArrowArray* dictionary;
+
+	void (*release)(struct ArrowArray*);
+	void* private_data;
+};
+
+#endif  // ARROW_C_DATA_INTERFACE
+
+#ifndef ARROW_C_STREAM_INTERFACE
+#define ARROW_C_STREAM_INTERFACE
+
+struct ArrowArrayStream
+{
+	int (*get_schema)(struct ArrowArrayStream*, struct ArrowSchema* out);
+	int (*get_next)(struct ArrowArrayStream*, struct ArrowArray* out);
+	const char* (*get_last_error)(struct ArrowArrayStream*);
+
+	void (*release)(struct ArrowArrayStream*);
+	void* private_data;
+};
+
+#endif  // ARROW_C_STREAM_INTERFACE
+
+namespace ECS
+{
+	namespace ArrowDetail
+	{
+		struct SchemaData
+		{
+			std::string               m_format;
+			std::string               m_name;
+			std::vector<ArrowSchema*> m_children;
+		};
+
+		struct ArrayData
+		{
+			std::vector<const void*>   m_buffers;
+			std::vector<ArrowArray*>   m_children;
+			std::vector<std::uint8_t>  m_validity;
+			std::vector<std::byte>     m_values;  // Only used when the values had to be copied
+		};
+
+		inline void ReleaseSchema(ArrowSchema* schema)
+		{
+			SchemaData* data = static_cast<SchemaData*>(schema->private_data);
+			for (ArrowSchema* child : data->m_children)
+			{
+				if (child->release)
+					child->release(child);
+				delete child;
+			}
+
+			delete data;
+			schema->release = nullptr;
+		}
+
+		inline void MakeSchema(ArrowSchema* out, std::string format, std::string name, int64_t flags, std::vector<ArrowSchema*> children)
+		{
+			SchemaData* data = new SchemaData{ std::move(format), std::move(name), std::move(children) };
+
+			*out = ArrowSchema
+			{
+				data->m_format.c_str(),
+				data->m_name.c_str(),
+				nullptr,
+				flags,
+				int64_t(data->m_children.size()),
+				data->m_children.data(),
+				nullptr,
+				&ReleaseSchema,
+				data
+			};
+		}
+
+		inline void ReleaseArray(ArrowArray* array)
+		{
+			ArrayData* data = static_cast<ArrayData*>(array->private_data);
+			for (ArrowArray* child : data->m_children)
+			{
+				if (child->release)
+					child->release(child);
+				delete child;
+			}
+
+			delete data;
+			array->release = nullptr;
+		}
+
+		// Takes ownership of 'data', whose buffers and children must already be filled in
+		inline void MakeArray(ArrowArray* out, ArrayData* data, int64_t length, int64_t nullCount)
+		{
+			*out = ArrowArray
+			{
+				length,
+				nullCount,
+				0,
+				int64_t(data->m_buffers.size()),
+				int64_t(data->m_children.size()),
+				data->m_buffers.data(),
+				data->m_children.data(),
+				nullptr,
+				&ReleaseArray,
+				data
+			};
+		}
+
+		struct StreamData
+		{
+			World*                   m_world;
+			DynamicQuery             m_query;      // Query being exported, decides which rows match
+			std::vector<ComponentID> m_columns;    // Exported components, in schema order
+			size_t                   m_batchRows;
+			unsigned long long       m_version;    // Structural version the export started at
+			bool                     m_gather;     // Copy matches out instead of referencing pools
+			size_t                   m_nextIndex;  // Next entity index, when referencing pools
+			DynamicQuery             m_cursor;     // Next match, when gathering
+			DynamicQuery             m_end;
+			std::string              m_error;
+		};
+
+		inline ArrowArray* NewColumn(ArrayData* data, int64_t length, int64_t nullCount)
+		{
+			ArrowArray* column = new ArrowArray;
+			MakeArray(column, data, length, nullCount);
+			return column;
+		}
+
+		// Builds a batch over the entity index range starting at m_nextIndex, component
+		// values are referenced in place and non-matching rows are marked null
+		inline void NextRangeBatch(StreamData& stream, ArrayData* batch, int64_t& length)
+		{
+			World& world = *stream.m_world;
+			size_t first = stream.m_nextIndex;
+			size_t count = std::min(stream.m_batchRows, world.All().size() - first);
+
+			std::vector<std::uint8_t> validity((count + 7) / 8, 0);
+			int64_t nullCount = 0;
+			for (size_t row = 0; row < count; row++)
+			{
+				if (stream.m_query.Matches(EntityIndex(first + row)))
+					validity[row / 8] |= std::uint8_t(1u << (row % 8));
+				else
+					nullCount++;
+			}
+
+			ArrayData* entities = new ArrayData;
+			entities->m_validity = validity;
+			entities->m_values.resize(count * sizeof(EntityID));
+			for (size_t row = 0; row < count; row++)
+			{
+				EntityID id = world.GetEntityId(EntityIndex(first + row));
+				std::memcpy(&entities->m_values[row * sizeof(EntityID)], &id, sizeof(EntityID));
+			}
+			entities->m_buffers = { entities->m_validity.data(), entities->m_values.data() };
+			batch->m_children.push_back(NewColumn(entities, int64_t(count), nullCount));
+
+			for (ComponentID componentId : stream.m_columns)
+			{
+				const ComponentPool* pool = world.GetPool(componentId);
+
+				ArrayData* column = new ArrayData;
+				column->m_validity = validity;
+
+				if (first + count <= pool->Capacity())
+				{
+					column->m_buffers = { column->m_validity.data(), pool->Data() + first * pool->ElementSize() };
+				}
+				else
+				{
+					// The pool's storage ends inside this batch, no entity past it owns the component
+					// so copy what there is and leave the null rows zeroed
+					size_t covered = pool->Capacity() > first ? pool->Capacity() - first : 0;
+					column->m_values.resize(count * pool->ElementSize());
+					if (covered > 0)
+						std::memcpy(column->m_values.data(), pool->Data() + first * pool->ElementSize(), covered * pool->ElementSize());
+
+					column->m_buffers = { column->m_validity.data(), column->m_values.data() };
+				}
+				batch->m_children.push_back(NewColumn(column, int64_t(count), nullCount));
+			}
+
+			stream.m_nextIndex += count;
+			length = int64_t(count);
+		}
+
+		// Builds a batch from the next matches of a sparse query, copying their values
+		inline void NextGatherBatch(StreamData& stream, ArrayData* batch, int64_t& length)
+		{
+			World& world = *stream.m_world;
+
+			std::vector<EntityID> ids;
+			while (ids.size() < stream.m_batchRows && stream.m_cursor != stream.m_end)
+			{
+				ids.push_back(*stream.m_cursor);
+				++stream.m_cursor;
+			}
+
+			ArrayData* entities = new ArrayData;
+			entities->m_values.resize(ids.size() * sizeof(EntityID));
+			std::memcpy(entities->m_values.data(), ids.data(), entities->m_values.size());
+			entities->m_buffers = { nullptr, entities->m_values.data() };
+			batch->m_children.push_back(NewColumn(entities, int64_t(ids.size()), 0));
+
+			for (ComponentID componentId : stream.m_columns)
+			{
+				const ComponentPool* pool = world.GetPool(componentId);
+				size_t elementSize = pool->ElementSize();
+
+				ArrayData* column = new ArrayData;
+				column->m_values.resize(ids.size() * elementSize);
+				for (size_t row = 0; row < ids.size(); row++)
+				{
+					std::memcpy(&column->m_values[row * elementSize], pool->Data() + GetEntityIndex(ids[row]) * elementSize, elementSize);
+				}
+				column->m_buffers = { nullptr, column->m_values.data() };
+				batch->m_children.push_back(NewColumn(column, int64_t(ids.size()), 0));
+			}
+
+			length = int64_t(ids.size());
+		}
+
+		inline int GetSchema(ArrowArrayStream* stream, ArrowSchema* out)
+		{
+			StreamData& data = *static_cast<StreamData*>(stream->private_data);
+
+			std::vector<ArrowSchema*> fields;
+
+			ArrowSchema* entity = new ArrowSchema;
+			MakeSchema(entity, "L", "entity", ARROW_FLAG_NULLABLE, {});
+			fields.push_back(entity);
+
+			for (ComponentID componentId : data.m_columns)
+			{
+				const ComponentInfo& info = GetComponentInfo(componentId);
+
+				ArrowSchema* field = new ArrowSchema;
+				MakeSchema(field, "w:" + std::to_string(info.m_size), std::string(info.m_name), ARROW_FLAG_NULLABLE, {});
+				fields.push_back(field);
+			}
+
+			MakeSchema(out, "+s", "", 0, std::move(fields));
+			return 0;
+		}
+
+		inline int GetNext(ArrowArrayStream* stream, ArrowArray* out)
+		{
+			StreamData& data = *static_cast<StreamData*>(stream->private_data);
+
+			if (data.m_world->StructuralVersion() != data.m_version)
+			{
+				data.m_error = "World changed structurally during the export";
+				return EINVAL;
+			}
+
+			bool finished = data.m_gather ? !(data.m_cursor != data.m_end) : data.m_nextIndex >= data.m_world->All().size();
+			if (finished)
+			{
+				out->release = nullptr;  // Marks the end of the stream
+				return 0;
+			}
+
+			ArrayData* batch = new ArrayData;
+			batch->m_buffers = { nullptr };
+
+			int64_t length = 0;
+			if (data.m_gather)
+				NextGatherBatch(data, batch, length);
+			else
+				NextRangeBatch(data, batch, length);
+
+			MakeArray(out, batch, length, 0);
+			return 0;
+		}
+
+		inline const char* GetLastError(ArrowArrayStream* stream)
+		{
+			StreamData& data = *static_cast<StreamData*>(stream->private_data);
+			return data.m_error.empty() ? nullptr : data.m_error.c_str();
+		}
+
+		inline void ReleaseStream(ArrowArrayStream* stream)
+		{
+			delete static_cast<StreamData*>(stream->private_data);
+			stream->release = nullptr;
+		}
+	}
+
+	// Writes the query's matches into 'stream' as Arrow record batches of up to 'batchRows' rows.
+	// Components that are not trivially copyable have no byte layout to export and are left out
+	inline void ExportArrow(World& world, const DynamicQuery& query, ArrowArrayStream* stream, size_t batchRows = 65536)
+	{
+		const ComponentMask& mask = query.Mask();
+
+		std::vector<ComponentID> columns;
+		for (ComponentID componentId = 0; componentId < ComponentCount(); componentId++)
+		{
+			if (mask.test(componentId) && GetComponentInfo(componentId).m_triviallyCopyable && world.GetPool(componentId))
+				columns.push_back(componentId);
+		}
+
+		// Referencing pools in place pays off when most of the table matches, which is
+		// exactly when the planner would rather scan than drive from a pool. Where clauses
+		// are only evaluated by iterating, so their queries always gather
+		bool gather = world.PlanQuery(mask) != nullptr || query.HasClauses();
+
+		ArrowDetail::StreamData* data = new ArrowDetail::StreamData
+		{
+			&world,
+			query,
+			std::move(columns),
+			batchRows,
+			world.StructuralVersion(),
+			gather,
+			0,
+			query.begin(),
+			query.end(),
+			{}
+		};
+
+		*stream = ArrowArrayStream
+		{
+			&ArrowDetail::GetSchema,
+			&ArrowDetail::GetNext,
+			&ArrowDetail::GetLastError,
+			&ArrowDetail::ReleaseStream,
+			data
+		};
+	}
+}
@@ -0,0 +1,163 @@
+#include "ECS_C.h"
+#include "ECS.h"
+
+static_assert(sizeof(ECS::EntityIndex) == sizeof(uint32_t), "Query rows are exposed as 32 bit entity indices");
+
+struct ecs_query
+{
+	ECS::World*                   world;
+	std::vector<ECS::ComponentID> terms;
+	std::vector<uint32_t>         rows;     // Entity indices matched by the last execute
+	uint64_t                      version;  // World structural version the rows were captured at
+};
+
+namespace
+{
+	ECS::World* ToWorld(ecs_world* world)
+	{
+		return reinterpret_cast<ECS::World*>(world);
+	}
+
+	const ECS::World* ToWorld(const ecs_world* world)
+	{
+		return reinterpret_cast<const ECS::World*>(world);
+	}
+
+	// Hosts can pass any number, including ECS_INVALID_COMPONENT from a failed find.
+	// Only registered user components are accepted, never the entity state bits, and only
+	// trivially copyable ones, since scripts read and write them as plain bytes
+	bool IsComponent(ecs_component component)
+	{
+		return component < ECS::ComponentCount() && ECS::GetComponentInfo(component).m_triviallyCopyable;
+	}
+}
+
+ecs_world* ecs_world_create(void)
+{
+	return reinterpret_cast<ecs_world*>(new ECS::World());
+}
+
+void ecs_world_destroy(ecs_world* world)
+{
+	delete ToWorld(world);
+}
+
+uint64_t ecs_world_version(const ecs_world* world)
+{
+	return ToWorld(world)->StructuralVersion();
+}
+
+ecs_entity ecs_entity_new(ecs_world* world)
+{
+	return ToWorld(world)->NewEntity();
+}
+
+void ecs_entity_destroy(ecs_world* world, ecs_entity entity)
+{
+	ToWorld(world)->DestroyEntity(entity);
+}
+
+uint32_t ecs_entity_index(ecs_entity entity)
+{
+	return ECS::GetEntityIndex(entity);
+}
+
+ecs_component ecs_component_register(const char* name, size_t size, size_t alignment)
+{
+	return ECS::RegisterComponent(name, size, alignment);
+}
+
+ecs_component ecs_component_find(const char* name)
+{
+	return ECS::FindComponent(ECS::HashName(name));
+}
+
+void* ecs_assign(ecs_world* world, ecs_entity entity, ecs_component component, const void* bytes)
+{
+	if (!IsComponent(component))
+		return nullptr;
+
+	return ToWorld(world)->AssignRaw(entity, component, bytes);
+}
+
+void* ecs_get(ecs_world* world, ecs_entity entity, ecs_component component)
+{
+	if (!IsComponent(component))
+		return nullptr;
+
+	return ToWorld(world)->GetRaw(entity, component);
+}
+
+void ecs_remove(ecs_world* world, ecs_entity entity, ecs_component component)
+{
+	if (IsComponent(component))
+		ToWorld(world)->RemoveRaw(entity, component);
+}
+
+ecs_query* ecs_query_create(ecs_world* world, const ecs_component* components, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		if (!IsComponent(components[i]))
+			return nullptr;
+	}
+
+	ecs_query* query = new ecs_query{ ToWorld(world), {}, {}, 0 };
+	query->terms.assign(components, components + count);
+	return query;
+}
+
+void ecs_query_destroy(ecs_query* query)
+{
+	delete query;
+}
+
+size_t ecs_query_execute(ecs_query* query)
+{
+	query->rows.clear();
+	for (ECS::EntityID id : ECS::DynamicQuery(*query->world, query->terms))
+	{
+		query->rows.push_back(ECS::GetEntityIndex(id));
+	}
+
+	query->version = query->world->StructuralVersion();
+	return query->rows.size();
+}
+
+const uint32_t* ecs_query_rows(const ecs_query* query)
+{
+	return query->rows.data();
+}
+
+size_t ecs_query_count(const ecs_query* query)
+{
+	return query->rows.size();
+}
+
+int ecs_query_column(const ecs_query* query, size_t term, ecs_column* out)
+{
+	if (term >= query->terms.size())
+		return 0;
+
+	const ECS::ComponentPool* pool = query->world->GetPool(query->terms[term]);
+	if (pool == nullptr)
+		return 0;
+
+	// Pools are indexed by entity index, so the column can be handed out as is.
+	// Storage covers every entity index that owns the component, so every row is addressable
+	out->data         = pool->Data();
+	out->element_size = pool->ElementSize();
+	out->stride       = pool->ElementSize();
+	out->length       = pool->Capacity();
+	return 1;
+}
+
+uint64_t ecs_query_version(const ecs_query* query)
+{
+	return query->version;
+}
+
+int ecs_query_valid(const ecs_query* query)
+{
+	return query->version == query->world->StructuralVersion();
+}
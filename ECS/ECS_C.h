@@ -0,0 +1,72 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+* C interface to ECS::World for scripting hosts.
+* Query results are exposed as raw column pointers plus strides so an external numeric
+* library can read or write a component column directly, without a call per entity.
+* Columns and row lists stay valid until the world's structural version changes.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+	typedef struct ecs_world ecs_world;
+	typedef struct ecs_query ecs_query;
+
+	typedef uint64_t ecs_entity;
+	typedef uint64_t ecs_component;
+
+#define ECS_INVALID_COMPONENT ((ecs_component)-1)
+
+	// Strided view over one component, row 'i' lives at data + i * stride
+	typedef struct ecs_column
+	{
+		void*  data;
+		size_t element_size;
+		size_t stride;
+		size_t length;  // Number of addressable rows, one per entity index
+	} ecs_column;
+
+	ecs_world* ecs_world_create(void);
+	void       ecs_world_destroy(ecs_world* world);
+	uint64_t   ecs_world_version(const ecs_world* world);
+
+	ecs_entity ecs_entity_new(ecs_world* world);
+	void       ecs_entity_destroy(ecs_world* world, ecs_entity entity);  // Does nothing for destroyed or made-up entities
+	uint32_t   ecs_entity_index(ecs_entity entity);
+
+	ecs_component ecs_component_register(const char* name, size_t size, size_t alignment);
+	ecs_component ecs_component_find(const char* name);
+
+	// Unknown components, such as ECS_INVALID_COMPONENT, and destroyed or made-up entities are rejected:
+	// assign and get return NULL and remove does nothing.
+	// C++ components that are not trivially copyable have no byte representation and are rejected the same way
+	void* ecs_assign(ecs_world* world, ecs_entity entity, ecs_component component, const void* bytes);
+	void* ecs_get(ecs_world* world, ecs_entity entity, ecs_component component);
+	void  ecs_remove(ecs_world* world, ecs_entity entity, ecs_component component);
+
+	// Creates a query over entities owning every listed component, returns NULL if any component is unknown
+	ecs_query* ecs_query_create(ecs_world* world, const ecs_component* components, size_t count);
+	void       ecs_query_destroy(ecs_query* query);
+
+	// Runs the query and captures the matching rows, returns the number of matches
+	size_t ecs_query_execute(ecs_query* query);
+
+	// Entity indices of the matches from the last execute, use them to index the columns
+	const uint32_t* ecs_query_rows(const ecs_query* query);
+	size_t          ecs_query_count(const ecs_query* query);
+
+	// Fills 'out' with the column of the query's 'term'-th component, returns 0 if there is none.
+	// Writes through a column bypass field indices, change indexed fields through ecs_get
+	int ecs_query_column(const ecs_query* query, size_t term, ecs_column* out);
+
+	// World version the last execute was taken at, and whether the results are still valid
+	uint64_t ecs_query_version(const ecs_query* query);
+	int      ecs_query_valid(const ecs_query* query);
+
+#ifdef __cplusplus
+}
+#endif
@@ -55,6 +55,29 @@ struct Renderable
     bool renderable;
 };
 
+struct Team
+{
+    int id;
+};
+
+// One frame of system work: iteration, Get, entity churn, an index lookup and scratch memory
+void Frame(ECS::World& r)
+{
+    for (auto entity : ECS::RosterView<Transform>(r))
+        r.Get<Transform>(entity)->position.x += 1.0f;
+
+    ECS::EntityID spawned = r.NewEntity();
+    r.Assign<Transform>(spawned, 1.0f);
+    r.Assign<Team>(spawned, 2);
+
+    ECS::ScratchVector<ECS::EntityID> team(r.ScratchArena());
+    for (auto entity : r.Find<&Team::id>(2))
+        team.push_back(entity);
+
+    r.DestroyEntity(spawned);
+    r.EndFrame();
+}
+
 int main()
 {
 
@@ -120,6 +143,58 @@ int main()
         std::cout << transform->position.x << std::endl;
     }
 
+    std::cout << "-----" << std::endl;
+
+    // The entity being visited, and the ones visited before it, can lose components or be
+    // destroyed while iterating. Entities the loop has not reached yet must be left alone
+    for (int i = 0; i < 10; i++)
+        r.Assign<Renderable>(r.NewEntity());
+
+    for (auto entity : ECS::RosterView<Renderable>(r))
+        r.Remove<Renderable>(entity);
+
+    /*
+    * Every entity is visited, so no Renderable is left and this prints 0
+    */
+    std::cout << ECS::RosterView<Renderable>(r).Count() << std::endl;
+
+    for (int i = 0; i < 10; i++)
+        r.Assign<Renderable>(r.NewEntity());
+
+    int visited = 0;
+    ECS::EntityID previous = 0;
+    for (auto entity : ECS::RosterView<Renderable>(r))
+    {
+        if (visited > 0)
+            r.DestroyEntity(previous);
+
+        previous = entity;
+        visited++;
+    }
+
+    /*
+    * Destroying the entity visited before does not make the loop skip any, this prints 10
+    */
+    std::cout << visited << std::endl;
+
+    std::cout << "-----" << std::endl;
+
+    // Once a frame has run, running it again must not allocate
+    r.CreateIndex<&Team::id>();
+    for (int i = 0; i < 10; i++)
+        r.Assign<Team>(r.NewEntity(), i % 3);
+
+    Frame(r);
+    {
+        ECS::ZeroAllocationScope scope;
+        Frame(r);
+        std::cout << scope.AllocationCount() << std::endl;
+    }
+
+    /*
+    * The warmed up frame makes no allocations, this prints 0
+    */
+
 
     return 0;
 }
\ No newline at end of file